@@ -1,16 +1,118 @@
 #pragma once
 #include <common.h>
+#include <state.h>
+#include <blip.h>
 
-// Initialize APU + SDL audio
+// channel state
+typedef struct {
+    float phase;
+    float freq_hz;
+    float duty;
+    float volume;
+    int enabled;
+    // Envelope
+    u8 env_volume;
+    u8 env_initial_volume;
+    u8 env_direction;
+    u8 env_period;
+    int env_timer;
+    // Length counter
+    int length_enabled;
+    int length_counter;
+    // Sweep (CH1 only)
+    u8 sweep_period;
+    u8 sweep_direction;
+    u8 sweep_shift;
+    int sweep_timer;
+    u16 sweep_frequency;
+} Square;
+
+typedef struct {
+    float phase;
+    float freq_hz;
+    float volume;
+    int enabled;
+    u8 waveform[32];
+    int length_enabled;
+    int length_counter;
+} Wave;
+
+typedef struct {
+    float phase;
+    float freq_hz;
+    float volume;
+    int enabled;
+    u32 lfsr;
+    int width_mode;
+    // Envelope
+    u8 env_volume;
+    u8 env_initial_volume;
+    u8 env_direction;
+    u8 env_period;
+    int env_timer;
+    // Length counter
+    int length_enabled;
+    int length_counter;
+} Noise;
+
+// register writes are queued with their timestamp and applied when the
+// APU is next caught up, so samples are rendered in long spans.
+#define APU_LOG_SIZE 256
+
+typedef struct {
+    u64 tick;
+    u16 address;
+    u8 value;
+} apu_write_entry;
+
+typedef struct {
+    Square ch1, ch2;
+    Wave ch3;
+    Noise ch4;
+
+    // master control
+    int master_enabled;
+    float master_volume_left;
+    float master_volume_right;
+
+    u8 regs[0x30]; // 0xFF10-0xFF3F
+
+    int frame_sequencer;
+    int frame_sequencer_counter;
+
+    u64 last_tick; // emu tick the APU has been stepped up to
+    double sample_acc; // cycles towards the next output sample
+    float noise_last; // last noise output level
+
+    float amp[4][2]; // level each channel last put into each side
+    blip_buffer blip[2]; // band-limited left and right mixes
+
+    // pending writes, always flushed before the state is saved
+    u32 log_len;
+    apu_write_entry log[APU_LOG_SIZE];
+} apu_context;
+
+// Reset APU state and start the frame sequencer
 void apu_init();
 
+// Open the SDL audio device, stereo at 'rate' Hz (0 for the default 48000).
+// false if there is no audio output.
+bool apu_audio_init(u32 rate);
+
+// Sleeps until the audio ring has drained back to its target fill
+void apu_audio_wait();
+
 // Cleanup on shutdown
 void apu_quit();
 
-// Called each CPU cycle
+// Advance the APU by a span of CPU cycles
 void apu_step(int cycles);
 
+// Scheduler callback, runs the APU up to the next frame sequencer step
+void apu_event(u64 now);
+
 // I/O mapping
 u8 apu_read(u16 address);
 void apu_write(u16 address, u8 value);
 
+void apu_serialize(state_buf *s);
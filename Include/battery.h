@@ -0,0 +1,21 @@
+#pragma once
+
+#include <common.h>
+
+// writes battery saves from a background thread. the emulation thread only
+// copies what changed into a staging image, the thread writes the whole
+// image to a temp file and renames it over the save, so the emulation never
+// waits on the disk and a crash leaves either the old save or the new one.
+typedef struct battery_writer battery_writer;
+
+// image starts out as a copy of 'data', NULL if the thread can't start.
+battery_writer *battery_writer_start(const char *path, const u8 *data, u32 size);
+
+// the staging image, only to be touched between lock and unlock.
+u8 *battery_writer_lock(battery_writer *w);
+
+// wakes the thread up to write the image when it was changed.
+void battery_writer_unlock(battery_writer *w, bool changed);
+
+// writes anything still pending and ends the thread.
+void battery_writer_stop(battery_writer *w);
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <common.h>
+
+// band-limited step synthesis. channels add a delta whenever their output
+// level changes, at a fractional sample time, and reading integrates the
+// deltas back into samples. each delta is spread over BLIP_TAPS samples by
+// a windowed sinc so square edges no longer alias.
+#define BLIP_TAPS 16
+#define BLIP_PHASES 64
+
+// most samples that can be read in one go.
+#define BLIP_SIZE 128
+
+typedef struct {
+    float deltas[BLIP_SIZE + BLIP_TAPS];
+    float acc; // running sum of everything read so far
+} blip_buffer;
+
+void blip_clear(blip_buffer *b);
+
+// adds an amplitude change at time t, in samples from the next read.
+// t must be below the count passed to that read.
+void blip_add(blip_buffer *b, float t, float delta);
+
+// integrates n samples into out scaled by gain and clamped to [-1, 1].
+// output lags the deltas by BLIP_TAPS / 2 samples.
+void blip_read(blip_buffer *b, float *out, int n, float gain);
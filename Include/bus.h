@@ -2,8 +2,24 @@
 
 #include <common.h>
 
+// page tables of direct host pointers, one entry per 256 bytes.
+// ROM, VRAM, WRAM and enabled cartridge RAM are mapped here, anything with
+// side effects (MBC registers, OAM, I/O) is left NULL and takes the slow path.
+typedef struct {
+    u8 *read_map[0x100];
+    u8 *write_map[0x100];
+} bus_context;
+
 u8 bus_read(u16 address);
 void bus_write(u16 address, u8 value);
 
 u16 bus_read16(u16 address);
-void bus_write16(u16 address, u16 value);
\ No newline at end of file
+void bus_write16(u16 address, u16 value);
+
+// points the 256 byte pages covering [address, address + size) straight at
+// host memory. a NULL pointer sends those pages back through the slow path.
+void bus_map(u16 address, u32 size, u8 *read, u8 *write);
+
+// host memory behind the readable page holding address, or NULL when reads
+// there go through the slow path.
+u8 *bus_read_page(u16 address);
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
+#include <battery.h>
 
 // Cartridge header information below was taken from the pandocs found in the read me.
 // you can learn more about these under cartridges section 16
@@ -21,11 +23,83 @@ typedef struct {
 	u16 global_checksum;
 } rom_header;
 
+// bank switching for one kind of cartridge, picked once when it's loaded.
+// the bus only calls these for what isn't mapped directly: bank registers
+// and cartridge ram.
+typedef struct {
+    u8 (*read)(u16 address);
+    void (*write)(u16 address, u8 value);
+    bool ram_open; //ram works without being enabled, carts without an mbc.
+    bool ram_nibbles; //mbc2's built in 512 x 4 bit ram.
+} cart_mapper;
+
+typedef struct {
+    char filename[1024];
+    char save_path[2100]; //battery file, looked up once when loading.
+    u32 rom_size;
+    u8 *rom_data; //read only, mapped from the file when possible.
+    rom_header header; //copy of the rom's header with the title terminated.
+    const cart_mapper *mapper;
+
+    //mbc related data
+    bool ram_enabled;
+    bool ram_banking;
+
+    u8 *rom_bank_x;
+    u8 banking_mode;
+
+    u16 rom_bank_value;
+    u8 ram_bank_value;
+
+    u8 *ram_bank; //current selected ram bank
+    u8 *ram_banks[16]; //all ram banks
+    u8 ram_bank_number; //index of ram_bank in ram_banks
+
+    //mbc3 real time clock: seconds, minutes, hours, day low, day high.
+    u8 rtc_select; //0x08-0x0C while a clock register replaces ram.
+    u8 rtc[5];
+    u8 rtc_latched[5]; //copy the game reads, taken on a 0 then 1 latch write.
+    u8 rtc_latch;
+    u64 rtc_ticks; //tick the clock has counted up to.
+
+    bool rom_shared; //rom_data belongs to another machine.
+    bool rom_mapped; //rom_data is a file mapping rather than heap memory.
+
+    //for battery
+    bool battery; //has battery
+    bool need_save; //should save battery backup.
+    u32 ram_dirty[16]; //256 byte pages of each bank written since the last save.
+    battery_writer *battery_writer;
+} cart_context;
+
 bool cart_load(char *cart);
 
+// loads the same game into the current machine from an already loaded cart,
+// sharing its read-only rom_data. ram starts out empty and battery files are
+// left alone.
+void cart_attach(cart_context *src);
+
+// releases the rom and ram of a cart, which doesn't have to be selected.
+void cart_free(cart_context *cart);
+
 u8 cart_read(u16 address);
 void cart_write(u16 address, u8 value);
 
+// rom bank currently switched in at 0x4000-0x7FFF
+u16 cart_rom_bank();
+
+// directory for battery saves, "../saves" unless set before loading.
+void cart_set_save_dir(const char *dir);
+
 bool cart_need_save();
 void cart_battery_load();
-void cart_battery_save();
\ No newline at end of file
+
+// hands the pages written since the last call to the save thread.
+void cart_battery_save();
+
+// saves what's left and waits for it to be on disk.
+void cart_battery_close();
+
+u16 cart_global_checksum();
+
+void cart_serialize(state_buf *s);
@@ -10,6 +10,9 @@ typedef uint16_t u16;
 typedef uint32_t u32;
 typedef uint64_t u64;
 
+// T-cycles per second
+#define GB_CPU_HZ 4194304
+
 // macros for getting and setting bits on a number
 #define BIT(a, n) ((a & (1 << n)) ? 1 : 0)
 
@@ -18,6 +21,9 @@ typedef uint64_t u64;
 // macro for checking the numbers between 2 values
 #define BETWEEN(a, b, c) ((a >= b) && (a <= c))
 
+// force inlining so constant arguments fold away.
+#define ALWAYS_INLINE static inline __attribute__((always_inline))
+
 void delay(u32 ms);
 
 #define NO_IMPL { fprintf(stderr, "NOT YET IMPLEMENTED\n"); exit(-5); }
\ No newline at end of file
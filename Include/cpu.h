@@ -1,6 +1,7 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
 #include <instructions.h>
 
 typedef struct {
@@ -18,6 +19,8 @@ typedef struct {
     u16 sp;
 } cpu_registers;
 
+typedef struct _cached_op cached_op;
+
 typedef struct {
     cpu_registers regs;
 
@@ -27,6 +30,7 @@ typedef struct {
     bool dest_is_mem;
     u8 cur_opcode;
     instruction *cur_inst;
+    cached_op *cur_op; //pre-decoded op when running from the block cache.
 
     bool halted;
     bool stepping;
@@ -45,13 +49,94 @@ bool cpu_step();
 
 typedef void (*IN_PROC)(cpu_context *);
 
-IN_PROC inst_get_processor(in_type type);
+//handler specialized for one opcode, fetches its operands and executes it.
+IN_PROC cpu_op_handler(u8 opcode);
+
+//pre-decoded instruction, immediates already read from rom.
+struct _cached_op {
+    u8 opcode;
+    u8 length;
+    u16 operand;
+    instruction *inst;
+    IN_PROC proc;
+};
+
+#define BLOCK_MAX_OPS 16
+#define CACHE_SLOTS 1024
+
+typedef struct {
+    bool valid;
+    u16 bank;
+    u16 pc;
+    u8 count;
+    cached_op ops[BLOCK_MAX_OPS];
+} cpu_block;
+
+typedef struct {
+    cpu_block blocks[CACHE_SLOTS];
+
+    //where we are in the block being executed.
+    cpu_block *cur_block;
+    u8 cur_index;
+    u16 next_pc;
+} cpu_cache_context;
+
+void cpu_cache_init();
+
+//next op for pc from the (rom bank, pc) keyed block cache.
+//returns NULL for code outside of rom, which is decoded every time.
+cached_op *cpu_cache_fetch(u16 pc);
 
 #define CPU_FLAG_Z BIT(context->regs.f, 7)
 #define CPU_FLAG_N BIT(context->regs.f, 6)
 #define CPU_FLAG_H BIT(context->regs.f, 5)
 #define CPU_FLAG_C BIT(context->regs.f, 4)
 
+//register access on the given registers, a plain field access when rt is constant.
+static inline u16 cpu_regs_read(cpu_registers *regs, reg_type rt) {
+    switch(rt) {
+        case RT_A: return regs->a;
+        case RT_F: return regs->f;
+        case RT_B: return regs->b;
+        case RT_C: return regs->c;
+        case RT_D: return regs->d;
+        case RT_E: return regs->e;
+        case RT_H: return regs->h;
+        case RT_L: return regs->l;
+
+        case RT_AF: return (regs->a << 8) | regs->f;
+        case RT_BC: return (regs->b << 8) | regs->c;
+        case RT_DE: return (regs->d << 8) | regs->e;
+        case RT_HL: return (regs->h << 8) | regs->l;
+
+        case RT_PC: return regs->pc;
+        case RT_SP: return regs->sp;
+        default: return 0;
+    }
+}
+
+static inline void cpu_regs_write(cpu_registers *regs, reg_type rt, u16 val) {
+    switch(rt) {
+        case RT_A: regs->a = val & 0xFF; break;
+        case RT_F: regs->f = val & 0xFF; break;
+        case RT_B: regs->b = val & 0xFF; break;
+        case RT_C: regs->c = val & 0xFF; break;
+        case RT_D: regs->d = val & 0xFF; break;
+        case RT_E: regs->e = val & 0xFF; break;
+        case RT_H: regs->h = val & 0xFF; break;
+        case RT_L: regs->l = val & 0xFF; break;
+
+        case RT_AF: regs->a = val >> 8; regs->f = val & 0xFF; break;
+        case RT_BC: regs->b = val >> 8; regs->c = val & 0xFF; break;
+        case RT_DE: regs->d = val >> 8; regs->e = val & 0xFF; break;
+        case RT_HL: regs->h = val >> 8; regs->l = val & 0xFF; break;
+
+        case RT_PC: regs->pc = val; break;
+        case RT_SP: regs->sp = val; break;
+        default: break;
+    }
+}
+
 u16 cpu_read_reg(reg_type rt);
 void cpu_set_reg(reg_type rt, u16 val);
 
@@ -64,4 +149,6 @@ void cpu_set_reg8(reg_type rt, u8 val);
 u8 cpu_get_int_flags();
 void cpu_set_int_flags(u8 value);
 
-void inst_to_str(cpu_context *context, char *str);
\ No newline at end of file
+void inst_to_str(cpu_context *context, char *str);
+
+void cpu_serialize(state_buf *s);
@@ -3,5 +3,10 @@
 #include <common.h>
 #include <cpu.h>
 
+typedef struct {
+    char msg[1024]; //serial output, blargg tests print their results here.
+    int msg_size;
+} dbg_context;
+
 void dbg_update();
 void dbg_print();
\ No newline at end of file
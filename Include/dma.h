@@ -1,8 +1,25 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
+
+// an OAM DMA transfer copies 160 bytes, one per M-cycle, after two M-cycles
+// of start delay. the CPU can't reach OAM until the last byte has landed.
+#define DMA_LENGTH 0xA0
+#define DMA_DURATION ((2 + DMA_LENGTH) * 4)
+
+typedef struct {
+    u64 end; // tick OAM is released, transfers are timed by this alone
+    u8 byte;
+    u8 value;
+} dma_context;
 
 void dma_start(u8 start);
-void dma_tick();
 
-bool dma_transferring();
\ No newline at end of file
+// scheduler callback. copies the whole transfer at once when the source is
+// plain memory, otherwise the next byte of it.
+void dma_event(u64 now);
+
+bool dma_transferring();
+
+void dma_serialize(state_buf *s);
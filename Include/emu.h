@@ -2,16 +2,47 @@
 
 #include <common.h>
 
+// what the cpu thread waits on between frames.
+typedef enum {
+	PACE_TIMER, // wall clock at the real 59.73 Hz
+	PACE_AUDIO, // keep the audio ring at its target fill
+	PACE_VSYNC // stay one frame ahead of the display
+} emu_pacing;
+
 typedef struct {
 	bool paused;
 	bool running;
 	bool die;
 	u64 ticks; // processor/timer ticks
+
+	bool headless; // no window/audio, no frame pacing
+	u32 max_frames; // stop after this many frames (0 = run forever)
+	emu_pacing pacing;
+	u32 state_size; // save state size, 0 until counted for the loaded cart
 } emu_context; // data about the running emulator
 
 int emu_run(int argc, char **argv);
 
 emu_context *emu_get_context();
 
+// powers on the current machine, the cart must already be loaded.
+void emu_reset();
+
+// runs the current machine on the calling thread until it has produced
+// 'frames' more frames.
+void emu_step_frames(u32 frames);
+
 void emu_cycles(int cpu_cycles);
 
+// halted cpu: skips straight to the next scheduled event.
+void emu_idle();
+
+// save states, the cpu thread must be paused (or not running) around these.
+u32 emu_state_size();
+
+// writes emu_state_size() bytes to buf, returns the size written or 0 when
+// buf can't hold that many.
+u32 emu_save_state(u8 *buf, u32 size);
+
+// false if buf isn't a state of this version taken from the loaded rom.
+bool emu_load_state(const u8 *buf, u32 size);
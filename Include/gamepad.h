@@ -1,6 +1,7 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
 
 typedef struct {
     bool start;
@@ -13,10 +14,27 @@ typedef struct {
     bool right;
 } gamepad_state;
 
+typedef struct {
+    bool button_sel;
+    bool dir_sel;
+    gamepad_state controller; //what the game sees, latched once a frame.
+    gamepad_state keys; //held down on the host right now.
+} gamepad_context;
+
 void gamepad_init();
 bool gamepad_button_sel();
 bool gamepad_dir_sel();
 void gamepad_set_sel(u8 value);
 
 gamepad_state *gamepad_get_state();
-u8 gamepad_get_output();
\ No newline at end of file
+
+// buttons the ui has held down, they reach the game at the next frame.
+gamepad_state *gamepad_get_keys();
+
+// one bit per button, in the order of gamepad_state.
+u8 gamepad_pack(const gamepad_state *state);
+void gamepad_unpack(u8 buttons, gamepad_state *state);
+
+u8 gamepad_get_output();
+
+void gamepad_serialize(state_buf *s);
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <common.h>
+#include <emu.h>
+#include <cpu.h>
+#include <bus.h>
+#include <cart.h>
+#include <ram.h>
+#include <ppu.h>
+#include <lcd.h>
+#include <timer.h>
+#include <dma.h>
+#include <gamepad.h>
+#include <io.h>
+#include <apu.h>
+#include <scheduler.h>
+#include <dbg.h>
+#include <replay.h>
+
+// one emulated machine. all state a running game touches lives here, so any
+// number of them can run side by side, each driven by its own thread.
+typedef struct gb {
+    emu_context emu;
+    cpu_context cpu;
+    cpu_cache_context cpu_cache;
+    bus_context bus;
+    cart_context cart;
+    ram_context ram;
+    ppu_context ppu;
+    lcd_context lcd;
+    timer_context timer;
+    dma_context dma;
+    gamepad_context gamepad;
+    io_context io;
+    apu_context apu;
+    sched_context sched;
+    dbg_context dbg;
+    replay_context replay;
+} gb_t;
+
+// machine the calling thread is driving, every subsystem call acts on it.
+// starts out as a built in default machine on every thread.
+extern _Thread_local gb_t *gb_cur;
+
+gb_t *gb_create();
+
+// frees the machine and its rom/ram buffers, must not be selected anywhere.
+void gb_destroy(gb_t *gb);
+
+// makes gb the calling thread's current machine.
+void gb_select(gb_t *gb);
@@ -1,6 +1,13 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
+
+typedef struct {
+    char serial_data[2];
+} io_context;
 
 u8 io_read(u16 address);
-void io_write(u16 address, u8 value);
\ No newline at end of file
+void io_write(u16 address, u8 value);
+
+void io_serialize(state_buf *s);
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
 
 typedef struct {
     //registers...
@@ -59,4 +60,6 @@ typedef enum {
 void lcd_init();
 
 u8 lcd_read(u16 address);
-void lcd_write(u16 address, u8 value);
\ No newline at end of file
+void lcd_write(u16 address, u8 value);
+
+void lcd_serialize(state_buf *s);
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cart.h>
+
+extern const cart_mapper mbc_none;
+extern const cart_mapper mbc1;
+extern const cart_mapper mbc2;
+extern const cart_mapper mbc3;
+extern const cart_mapper mbc5;
+
+// mapper for a cartridge type from the header, no mbc for unsupported ones.
+const cart_mapper *mbc_for_type(u8 type);
+
+// counts the mbc3 clock up to the current tick.
+void mbc_rtc_update();
+
+// counts the mbc3 clock on by whole seconds, unless it's halted.
+void mbc_rtc_add(u64 secs);
+
+// points the bus page tables at the currently selected rom/ram banks.
+void cart_update_map();
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
+#include <stdatomic.h>
 
 static const int LINES_PER_FRAME = 154;
 static const int TICKS_PER_LINE = 456;
@@ -15,15 +17,16 @@ typedef enum {
     FS_PUSH
 } fetch_state;
 
-typedef struct _fifo_entry {
-    struct _fifo_entry *next;
-    u32 value; //32 bit color value.
-} fifo_entry;
+//the fetcher only pushes when 8 or fewer pixels are queued, so 16 slots is
+//always enough. must stay a power of two for the index masking.
+#define PIXEL_FIFO_SIZE 16
+#define PIXEL_FIFO_MASK (PIXEL_FIFO_SIZE - 1)
 
 typedef struct {
-    fifo_entry *head;
-    fifo_entry *tail;
-    u32 size;
+    u32 entries[PIXEL_FIFO_SIZE]; //32 bit color values.
+    u8 head;
+    u8 tail;
+    u8 size;
 } fifo;
 
 typedef struct {
@@ -34,6 +37,7 @@ typedef struct {
     u8 fetch_x;
     u8 bgw_fetch_data[3];
     u8 fetch_entry_data[6]; //oam data..
+    u8 fetch_entry_pixels[3][8]; //fetch_entry_data decoded, leftmost first.
     u8 map_y;
     u8 map_x;
     u8 tile_y;
@@ -63,20 +67,36 @@ typedef struct {
  Bit2-0 Palette number  **CGB Mode Only**     (OBP0-7)
  */
 
-typedef struct _oam_line_entry {
-    oam_entry entry;
-    struct _oam_line_entry *next;
-} oam_line_entry;
+//how pixel transfer is emulated. the fifo steps the fetcher dot by dot,
+//the scanline renderer draws the whole line when hblank starts.
+typedef enum {
+    PPU_FIFO,
+    PPU_SCANLINE
+} ppu_renderer;
+
+#define TILE_COUNT 384
 
 typedef struct {
     oam_entry oam_ram[40];
     u8 vram[0x2000];
 
+    //every tile in 0x8000-0x97FF decoded to one color index per pixel.
+    //ppu_vram_write marks tiles dirty, they're redecoded on next use.
+    u8 tile_cache[TILE_COUNT][64];
+    u64 tile_dirty[TILE_COUNT / 64];
+
     pixel_fifo_context pfc;
 
     u8 line_sprite_count; //0 to 10 sprites.
-    oam_line_entry *line_sprites; //linked list of current sprites on line.
-    oam_line_entry line_entry_array[10]; //memory to use for list.
+    oam_entry line_sprites[10]; //sprites on the current line sorted by x.
+
+    //oam indexes of the first 10 sprites on each visible line, in oam
+    //order. rebuilt when a line needs it after oam changed or the sprite
+    //height was switched.
+    u8 sprite_index[144][10];
+    u8 sprite_index_count[144];
+    u8 sprite_index_height;
+    bool oam_dirty;
 
     u8 fetched_entry_count;
     oam_entry fetched_entries[3]; //entries fetched during pipeline.
@@ -84,19 +104,66 @@ typedef struct {
 
     u32 current_frame;
     u32 line_ticks;
-    u32 *video_buffer;
+    u32 *video_buffer; //back buffer the pipeline is drawing into.
+
+    //triple buffered frame exchange with the ui thread. the ppu owns the
+    //back buffer, the ui owns the front one and finished frames are swapped
+    //through 'middle' with FRAME_NEW set until the ui picks them up.
+    u32 *frames[3];
+    u8 back;
+    u8 front;
+    _Atomic u8 middle;
+
+    u64 last_tick; //emu tick the ppu has been stepped up to.
+
+    //requested renderer, may be set from any thread. it's latched into
+    //line_renderer when a line's transfer starts. neither is saved in states.
+    _Atomic ppu_renderer renderer;
+    ppu_renderer line_renderer;
 } ppu_context;
 
+#define FRAME_NEW 0x80
+
 void ppu_init();
 void ppu_tick();
 
+// hands the finished back buffer over to the ui, called at VBlank.
+void ppu_frame_publish();
+
+// newest published frame, or NULL if nothing new came in since the last call.
+// only one thread may consume frames.
+u32 *ppu_frame_acquire();
+
+// scheduler callback, steps the ppu up to 'now' and plans its next wakeup.
+void ppu_event(u64 now);
+
 void ppu_oam_write(u16 address, u8 value);
 u8 ppu_oam_read(u16 address);
 
+// replaces all of oam at once, for dma transfers.
+void ppu_oam_load(const u8 *data);
+
 void ppu_vram_write(u16 address, u8 value);
 u8 ppu_vram_read(u16 address);
 
 ppu_context *ppu_get_context();
 
+void ppu_tile_decode(ppu_context *ppu, u16 tile);
+
+// color indices of one row of a tile (0-383, counted from 0x8000), leftmost first.
+static inline const u8 *ppu_tile_row(ppu_context *ppu, u16 tile, u8 row) {
+    if (ppu->tile_dirty[tile / 64] & (1ull << (tile % 64))) {
+        ppu_tile_decode(ppu, tile);
+    }
+
+    return &ppu->tile_cache[tile][row * 8];
+}
+
 void pipeline_fifo_reset();
-void pipeline_process();
\ No newline at end of file
+void pipeline_process();
+
+// line_ticks value pixel transfer ends on in scanline mode.
+u32 scanline_xfer_end();
+void scanline_render();
+
+void ppu_serialize(state_buf *s);
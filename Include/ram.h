@@ -1,9 +1,19 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
+
+typedef struct {
+    u8 wram[0x2000];
+    u8 hram[0x80];
+} ram_context;
+
+void ram_init();
 
 u8 wram_read(u16 address);
 void wram_write(u16 address, u8 value);
 
 u8 hram_read(u16 address);
-void hram_write(u16 address, u8 value);
\ No newline at end of file
+void hram_write(u16 address, u8 value);
+
+void ram_serialize(state_buf *s);
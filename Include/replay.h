@@ -0,0 +1,81 @@
+#pragma once
+
+#include <common.h>
+
+// input replays. a replay is a save state taken when recording started
+// followed by the buttons held on every frame after it, stored as runs of
+// frames with the same buttons. playing it back from that state repeats
+// the recording exactly.
+
+#define REPLAY_MAGIC 0x50524247 // "GBRP"
+#define REPLAY_VERSION 1
+
+// frames between the snapshots seeking starts from.
+#define REPLAY_KEYFRAME_INTERVAL 600
+
+typedef struct {
+    u32 magic;
+    u16 version;
+    u16 global_checksum;
+    u32 start_frame;
+    u32 frames;
+    u32 state_size; // the save state follows, then the runs
+} replay_header;
+
+typedef enum {
+    REPLAY_OFF,
+    REPLAY_RECORD,
+    REPLAY_PLAY
+} replay_mode;
+
+typedef struct {
+    replay_mode mode;
+    bool loaded; // a played replay stays around to seek in after it ends
+    char path[1024]; // where a recording gets written
+    u32 start_frame; // current_frame of the first frame in the replay
+    u32 frames; // frames recorded or available to play
+
+    // each run is a button byte and a frame count, 7 bits per byte with
+    // the top bit set on all but the last.
+    u8 *runs;
+    u32 runs_len;
+    u32 runs_cap;
+
+    u8 run_buttons; // run being recorded
+    u32 run_length;
+
+    u32 play_pos; // offset of the next run to decode
+    u32 play_start; // first frame of the decoded run
+    u32 play_length;
+    u8 play_buttons;
+
+    // keyframe n is a save state from frame n * REPLAY_KEYFRAME_INTERVAL.
+    u8 **keyframes;
+    u32 keyframe_count;
+    u32 keyframe_cap;
+    u32 state_size;
+
+    // set from any thread, carried out at the next frame.
+    bool record_pending;
+    bool seek_pending;
+    u32 seek_frame;
+} replay_context;
+
+// starts recording at the next frame, written to path by replay_stop().
+void replay_record(const char *path);
+
+// loads a replay made from the current rom and plays it from the next frame.
+bool replay_play(const char *path);
+
+// jumps to a frame of the replay being played, counted from its start.
+void replay_seek(u32 frame);
+
+// ends recording or playback, writes out a recording.
+void replay_stop();
+
+// called on the cpu thread between instructions once the ppu starts a new
+// frame. latches the input for it, from the host or the replay.
+void replay_frame();
+
+// frees the buffers of a machine's replay, which doesn't have to be selected.
+void replay_free(replay_context *replay);
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <common.h>
+#include <state.h>
+
+// subsystems that only need to run at a known tick instead of every T-cycle.
+typedef enum {
+    EV_TIMER, // next TIMA reload/interrupt
+    EV_PPU, // next mode transition (every dot while drawing)
+    EV_APU, // next frame sequencer step
+    EV_DMA, // next OAM DMA byte
+    EV_COUNT
+} sched_event;
+
+typedef void (*EV_PROC)(u64 now);
+
+#define SCHED_NEVER (~(u64)0)
+
+// each event is pending at most once, so the heap is indexed by event id
+// and rescheduling is a sift instead of a remove + insert.
+typedef struct {
+    u64 when[EV_COUNT];
+    u8 heap[EV_COUNT];
+    int pos[EV_COUNT]; //heap slot of each event, -1 when not pending.
+    u8 size;
+} sched_context;
+
+// sched_next() on a given scheduler, for the per M-cycle check in emu_cycles.
+static inline u64 sched_peek(sched_context *s) {
+    return s->size ? s->when[s->heap[0]] : SCHED_NEVER;
+}
+
+void sched_init();
+
+// (re)schedules an event to fire once the emu ticks reach 'when'.
+void sched_add(sched_event ev, u64 when);
+void sched_remove(sched_event ev);
+
+// tick of the earliest pending event.
+u64 sched_next();
+
+// fires every event that is due at or before 'now', in order.
+void sched_run(u64 now);
+
+void sched_serialize(state_buf *s);
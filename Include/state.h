@@ -0,0 +1,28 @@
+#pragma once
+
+#include <common.h>
+
+// cursor over a save state buffer. every subsystem has one xxx_serialize()
+// used for both directions so saving and loading can't drift apart.
+// with data == NULL nothing is copied and only the size is counted.
+// bump whenever any xxx_serialize() changes what it stores.
+#define STATE_VERSION 10
+#define STATE_MAGIC 0x53454247 //"GBES"
+
+typedef struct {
+    u32 magic;
+    u32 version;
+    u32 size; //whole state including this header.
+    u16 global_checksum; //of the rom the state was taken from.
+} state_header;
+
+typedef struct {
+    u8 *data;
+    u32 pos;
+    bool loading;
+} state_buf;
+
+void state_field(state_buf *s, void *field, u32 size);
+
+// plain (pointer free) values and arrays only.
+#define STATE_FIELD(s, v) state_field(s, &(v), sizeof(v))
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <common.h>
+#include <string.h>
+
+// 2bpp tile row decoding. a row is two bytes, the low and high bit planes,
+// with the leftmost pixel in bit 7 of each.
+
+// byte i of tile_spread[b] holds bit (7 - i) of b.
+extern const u64 tile_spread[256];
+
+// expands a row into 8 color indices (0-3), leftmost pixel first.
+static inline void tile_decode_row(u8 lo, u8 hi, u8 out[8]) {
+    u64 row = tile_spread[lo] | (tile_spread[hi] << 1);
+    memcpy(out, &row, 8);
+}
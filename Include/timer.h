@@ -1,18 +1,25 @@
 #pragma once
 
 #include <common.h>
+#include <state.h>
 
 typedef struct {
     u16 div; // divider register
     u8 tima; // timer counter
     u8 tma; // timer module
     u8 tac; // timer control
+
+    u64 sync_tick; // emu tick that div/tima were last brought up to
 } timer_context;
 
 void timer_init();
-void timer_tick();
+
+// scheduler callback, catches the timer up and plans the next TIMA reload.
+void timer_event(u64 now);
 
 void timer_write(u16 address, u8 value);
 u8 timer_read(u16 address);
 
-timer_context *timer_get_context();
\ No newline at end of file
+timer_context *timer_get_context();
+
+void timer_serialize(state_buf *s);
@@ -12,8 +12,11 @@ static const int SCREEN_HEIGHT = 144;
 void ui_init(void);
 void ui_cleanup(void);
 
-// Frame update (rendering)
-void ui_update(void);
+// Frame update (rendering), false if there was no new frame to show
+bool ui_update(void);
+
+// true when presenting blocks on the display's refresh
+bool ui_vsync(void);
 
 // Event handling
 void ui_handle_events(void);
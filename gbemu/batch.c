@@ -0,0 +1,243 @@
+#include <gb.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+
+// gbemu-batch: runs many copies of one game headless, spread over a pool of
+// worker threads, and reports the combined frame rate.
+//
+// machines are handed out in slices of SLICE_FRAMES. every worker owns a
+// deque of machines, works from the bottom of its own and steals from the
+// top of the others' once it runs dry, so a slow machine never leaves the
+// rest of the pool idle.
+
+#define SLICE_FRAMES 60
+#define MAX_THREADS 64
+
+typedef struct {
+    gb_t *gb;
+    u32 frames_left;
+} batch_machine;
+
+typedef struct {
+    pthread_mutex_t lock;
+    int *items; //machine indexes, [top, bottom).
+    int top;
+    int bottom;
+} work_deque;
+
+typedef struct {
+    batch_machine *machines;
+    int machine_count;
+
+    work_deque deques[MAX_THREADS];
+    int thread_count;
+
+    pthread_mutex_t done_lock;
+    int machines_done;
+} batch_context;
+
+static batch_context context;
+
+static void deque_push(work_deque *d, int item) {
+    pthread_mutex_lock(&d->lock);
+
+    if (d->top == d->bottom) {
+        d->top = d->bottom = 0;
+    }
+
+    d->items[d->bottom++] = item;
+    pthread_mutex_unlock(&d->lock);
+}
+
+static int deque_pop(work_deque *d) {
+    int item = -1;
+
+    pthread_mutex_lock(&d->lock);
+
+    if (d->bottom > d->top) {
+        item = d->items[--d->bottom];
+    }
+
+    pthread_mutex_unlock(&d->lock);
+    return item;
+}
+
+static int deque_steal(work_deque *d) {
+    int item = -1;
+
+    pthread_mutex_lock(&d->lock);
+
+    if (d->bottom > d->top) {
+        item = d->items[d->top++];
+    }
+
+    pthread_mutex_unlock(&d->lock);
+    return item;
+}
+
+static bool batch_finished() {
+    pthread_mutex_lock(&context.done_lock);
+    bool done = context.machines_done == context.machine_count;
+    pthread_mutex_unlock(&context.done_lock);
+
+    return done;
+}
+
+static int next_machine(int self) {
+    int item = deque_pop(&context.deques[self]);
+
+    for (int i=1; item < 0 && i<context.thread_count; i++) {
+        item = deque_steal(&context.deques[(self + i) % context.thread_count]);
+    }
+
+    return item;
+}
+
+static void *batch_worker(void *p) {
+    int self = (int)(intptr_t)p;
+
+    while (!batch_finished()) {
+        int item = next_machine(self);
+
+        if (item < 0) {
+            //everything left is being run by other workers.
+            usleep(100);
+            continue;
+        }
+
+        batch_machine *m = &context.machines[item];
+        u32 frames = m->frames_left < SLICE_FRAMES ? m->frames_left : SLICE_FRAMES;
+
+        gb_select(m->gb);
+        emu_step_frames(frames);
+        gb_select(NULL);
+
+        m->frames_left -= frames;
+
+        if (m->frames_left) {
+            deque_push(&context.deques[self], item);
+        } else {
+            pthread_mutex_lock(&context.done_lock);
+            context.machines_done++;
+            pthread_mutex_unlock(&context.done_lock);
+        }
+    }
+
+    return 0;
+}
+
+static u64 batch_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(int argc, char **argv) {
+    char *rom = NULL;
+    int machines = 8;
+    int threads = sysconf(_SC_NPROCESSORS_ONLN);
+    u32 frames = 600;
+    ppu_renderer renderer = PPU_FIFO;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--machines") && i + 1 < argc) {
+            machines = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--threads") && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            frames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--renderer") && i + 1 < argc) {
+            renderer = !strcmp(argv[++i], "scanline") ? PPU_SCANLINE : PPU_FIFO;
+        } else {
+            rom = argv[i];
+        }
+    }
+
+    if (!rom || machines < 1 || !frames) {
+        printf("Usage: gbemu-batch [--machines N] [--threads T] [--frames F] [--renderer fifo|scanline] <rom_file>\n");
+        return -1;
+    }
+
+    if (threads < 1) {
+        threads = 1;
+    }
+
+    if (threads > MAX_THREADS) {
+        threads = MAX_THREADS;
+    }
+
+    //the first machine loads the rom, the rest share its rom_data.
+    context.machine_count = machines;
+    context.machines = calloc(machines, sizeof(batch_machine));
+
+    for (int i=0; i<machines; i++) {
+        batch_machine *m = &context.machines[i];
+        m->gb = gb_create();
+        m->frames_left = frames;
+
+        gb_select(m->gb);
+        emu_get_context()->headless = true;
+        ppu_get_context()->renderer = renderer;
+
+        if (i == 0) {
+            if (!cart_load(rom)) {
+                printf("Failed to load ROM file: %s\n", rom);
+                return -2;
+            }
+        } else {
+            cart_attach(&context.machines[0].gb->cart);
+        }
+
+        emu_reset();
+    }
+
+    gb_select(NULL);
+
+    context.thread_count = threads;
+    pthread_mutex_init(&context.done_lock, NULL);
+
+    for (int i=0; i<threads; i++) {
+        work_deque *d = &context.deques[i];
+        pthread_mutex_init(&d->lock, NULL);
+        d->items = calloc(machines, sizeof(int));
+    }
+
+    for (int i=0; i<machines; i++) {
+        work_deque *d = &context.deques[i % threads];
+        d->items[d->bottom++] = i;
+    }
+
+    printf("Running %d machines x %u frames on %d threads\n", machines, frames, threads);
+
+    u64 start = batch_time_us();
+    pthread_t workers[MAX_THREADS];
+
+    for (int i=0; i<threads; i++) {
+        if (pthread_create(&workers[i], NULL, batch_worker, (void *)(intptr_t)i)) {
+            fprintf(stderr, "FAILED TO START WORKER THREAD!\n");
+            return -1;
+        }
+    }
+
+    for (int i=0; i<threads; i++) {
+        pthread_join(workers[i], NULL);
+    }
+
+    u64 elapsed = batch_time_us() - start;
+    u64 total = (u64)machines * frames;
+
+    printf("Ran %llu frames in %.3f s (%.1f FPS total, %.1f FPS per machine)\n",
+        (unsigned long long)total, elapsed / 1000000.0,
+        elapsed ? total * 1000000.0 / elapsed : 0.0,
+        elapsed ? total * 1000000.0 / elapsed / machines : 0.0);
+
+    //machine 0 owns the rom, free it last.
+    for (int i=machines - 1; i>=0; i--) {
+        gb_destroy(context.machines[i].gb);
+    }
+
+    return 0;
+}
@@ -4,72 +4,17 @@
 #include <string.h>
 #include <stdio.h>
 #include <math.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <unistd.h>
 #include "apu.h"
+#include <blip.h>
+#include <emu.h>
+#include <scheduler.h>
+#include <gb.h>
 
-#define SAMPLE_RATE 48000
+#define DEFAULT_SAMPLE_RATE 48000
 #define BUFFER_SIZE 8192
-#define GB_CPU_HZ 4194304
-
-// --- Channel structs ---
-typedef struct {
-    float phase;
-    float freq_hz;
-    float duty;
-    float volume;
-    int enabled;
-    // Envelope
-    uint8_t env_volume;
-    uint8_t env_initial_volume;
-    uint8_t env_direction;
-    uint8_t env_period;
-    int env_timer;
-    // Length counter
-    int length_enabled;
-    int length_counter;
-    // Sweep (CH1 only)
-    uint8_t sweep_period;
-    uint8_t sweep_direction;
-    uint8_t sweep_shift;
-    int sweep_timer;
-    uint16_t sweep_frequency;
-} Square;
-
-typedef struct {
-    float phase;
-    float freq_hz;
-    float volume;
-    int enabled;
-    uint8_t waveform[32];
-    int length_enabled;
-    int length_counter;
-} Wave;
-
-typedef struct {
-    float phase;
-    float freq_hz;
-    float volume;
-    int enabled;
-    uint32_t lfsr;
-    int width_mode;
-    // Envelope
-    uint8_t env_volume;
-    uint8_t env_initial_volume;
-    uint8_t env_direction;
-    uint8_t env_period;
-    int env_timer;
-    // Length counter
-    int length_enabled;
-    int length_counter;
-} Noise;
-
-static Square ch1, ch2;
-static Wave ch3;
-static Noise ch4;
-
-// Master control
-static int master_enabled = 1;
-static float master_volume_left = 1.0f;
-static float master_volume_right = 1.0f;
 
 // Debugging flags
 static int dbg_mute_ch1 = 0;
@@ -77,19 +22,31 @@ static int dbg_mute_ch2 = 0;
 static int dbg_mute_ch3 = 0;
 static int dbg_mute_ch4 = 0;
 
-// --- Registers 0xFF10–0xFF3F ---
-static uint8_t apu_regs[0x30];
-
 // --- Audio buffer ---
+// one output device per process, shared by whichever machine has audio enabled.
+// single producer (cpu thread) / single consumer (audio callback) ring, each
+// side only ever stores its own index so no lock is needed. the indices run
+// freely and are masked on access, BUFFER_SIZE must be a power of two.
+// samples are interleaved left/right and only ever move in whole frames.
 static float audio_buffer[BUFFER_SIZE];
-static volatile int write_pos = 0;
-static volatile int read_pos = 0;
+static _Atomic u32 write_pos = 0;
+static _Atomic u32 read_pos = 0;
 static SDL_AudioDeviceID audio_dev = 0;
-static SDL_mutex *audio_mutex = NULL;
+static u32 audio_rate = DEFAULT_SAMPLE_RATE;
+
+// dynamic rate control: the rate the channels are synthesized at is nudged
+// by up to DRC_MAX_DELTA so the ring holds audio_target frames, soaking up
+// the drift between emulation speed and the device clock.
+#define DRC_MAX_DELTA 0.005
+static u32 audio_target = 0;
+static float synth_rate = DEFAULT_SAMPLE_RATE;
+
+// samples are staged here and pushed to the ring a batch at a time
+#define AUDIO_BATCH 64
+static float audio_batch[AUDIO_BATCH];
+static int audio_batch_len = 0;
 
-// Frame sequencer
-static int frame_sequencer = 0;
-static int frame_sequencer_counter = 0;
+#define context (gb_cur->apu)
 
 // Duty cycle patterns
 static const float duty_patterns[4][8] = {
@@ -100,36 +57,83 @@ static const float duty_patterns[4][8] = {
 };
 
 // --- Helpers ---
-static int buffer_space_available(void) {
-    int space = read_pos - write_pos - 1;
-    if (space < 0) space += BUFFER_SIZE;
-    return space;
+// copies up to count samples into the ring, drops whatever does not fit.
+static void ring_push(const float *samples, u32 count) {
+    u32 w = atomic_load_explicit(&write_pos, memory_order_relaxed);
+    u32 r = atomic_load_explicit(&read_pos, memory_order_acquire);
+    u32 space = BUFFER_SIZE - 1 - (w - r);
+
+    if (count > space) count = space & ~1u;
+    if (!count) return;
+
+    u32 start = w & (BUFFER_SIZE - 1);
+    u32 first = BUFFER_SIZE - start;
+    if (first > count) first = count;
+
+    memcpy(audio_buffer + start, samples, first * sizeof(float));
+    memcpy(audio_buffer, samples + first, (count - first) * sizeof(float));
+
+    atomic_store_explicit(&write_pos, w + count, memory_order_release);
 }
 
-static void enqueue_sample(float s) {
-    if (buffer_space_available() > 0) {
-        if (s > 1.0f) s = 1.0f;
-        if (s < -1.0f) s = -1.0f;
-        audio_buffer[write_pos] = s;
-        write_pos = (write_pos + 1) % BUFFER_SIZE;
+// copies up to count samples out of the ring, returns how many were read.
+static u32 ring_pop(float *samples, u32 count) {
+    u32 r = atomic_load_explicit(&read_pos, memory_order_relaxed);
+    u32 w = atomic_load_explicit(&write_pos, memory_order_acquire);
+    u32 avail = w - r;
+
+    if (count > avail) count = avail;
+    if (!count) return 0;
+
+    u32 start = r & (BUFFER_SIZE - 1);
+    u32 first = BUFFER_SIZE - start;
+    if (first > count) first = count;
+
+    memcpy(samples, audio_buffer + start, first * sizeof(float));
+    memcpy(samples + first, audio_buffer, (count - first) * sizeof(float));
+
+    atomic_store_explicit(&read_pos, r + count, memory_order_release);
+    return count;
+}
+
+// frames queued for the device.
+static u32 ring_fill(void) {
+    u32 w = atomic_load_explicit(&write_pos, memory_order_relaxed);
+    u32 r = atomic_load_explicit(&read_pos, memory_order_relaxed);
+
+    return (w - r) / 2;
+}
+
+static void flush_samples(void) {
+    ring_push(audio_batch, audio_batch_len);
+    audio_batch_len = 0;
+}
+
+static void enqueue_samples(const float *samples, int n) {
+    while (n > 0) {
+        int count = AUDIO_BATCH - audio_batch_len;
+        if (count > n) count = n;
+
+        memcpy(audio_batch + audio_batch_len, samples, count * sizeof(float));
+        audio_batch_len += count;
+        samples += count;
+        n -= count;
+
+        if (audio_batch_len == AUDIO_BATCH) {
+            flush_samples();
+        }
     }
 }
 
 static void audio_callback(void *userdata, Uint8 *stream, int len) {
     (void)userdata;
     float *out = (float*)stream;
-    int samples = len / sizeof(float);
-    
-    SDL_LockMutex(audio_mutex);
-    for (int i = 0; i < samples; i++) {
-        if (read_pos != write_pos) {
-            out[i] = audio_buffer[read_pos];
-            read_pos = (read_pos + 1) % BUFFER_SIZE;
-        } else {
-            out[i] = 0.0f;
-        }
-    }
-    SDL_UnlockMutex(audio_mutex);
+    u32 samples = len / sizeof(float);
+
+    u32 n = ring_pop(out, samples);
+
+    // underrun, pad with silence
+    memset(out + n, 0, (samples - n) * sizeof(float));
 }
 
 // --- Envelope processing ---
@@ -222,229 +226,423 @@ static void update_length_noise(Noise *ch) {
     }
 }
 
-// --- Channel samples ---
-static float square_sample(Square *ch) {
-    if (!ch->enabled || !master_enabled) return 0.0f;
-    
-    int duty_index = (int)(ch->phase * 8.0f) & 7;
-    float s = duty_patterns[(int)(ch->duty * 3.99f)][duty_index] ? ch->volume : 0.0f;
-    
-    ch->phase += ch->freq_hz / SAMPLE_RATE;
-    while (ch->phase >= 1.0f) ch->phase -= 1.0f;
-    
-    return s;
+// --- Channel spans ---
+// each walks its channel across n samples and posts a delta to the blip
+// buffer at the exact time its output level changes. nothing a channel
+// depends on can change inside a span.
+static void set_level(int ch, float t, float level) {
+    // NR51 routes each channel to either side, NR50 scales each side
+    u8 pan = context.regs[0x15];
+    float left = (pan & (0x10 << ch)) ? level * context.master_volume_left : 0.0f;
+    float right = (pan & (0x01 << ch)) ? level * context.master_volume_right : 0.0f;
+
+    if (left != context.amp[ch][0]) {
+        blip_add(&context.blip[0], t, left - context.amp[ch][0]);
+        context.amp[ch][0] = left;
+    }
+
+    if (right != context.amp[ch][1]) {
+        blip_add(&context.blip[1], t, right - context.amp[ch][1]);
+        context.amp[ch][1] = right;
+    }
 }
 
-static float wave_sample(Wave *ch) {
-    if (!ch->enabled || !master_enabled) return 0.0f;
-    
-    int idx = (int)(ch->phase * 32.0f) & 31;
-    float s = (ch->waveform[idx] / 15.0f - 0.5f) * ch->volume * 2.0f;
-    
-    ch->phase += ch->freq_hz / SAMPLE_RATE;
-    while (ch->phase >= 1.0f) ch->phase -= 1.0f;
-    
-    return s;
+static void square_span(int id, Square *ch, int n) {
+    if (!ch->enabled || !context.master_enabled) {
+        set_level(id, 0, 0.0f);
+        return;
+    }
+
+    const float *pattern = duty_patterns[(int)(ch->duty * 3.99f)];
+    float step = ch->freq_hz / synth_rate;
+    float phase = ch->phase;
+    float volume = ch->volume;
+    int pos = (int)(phase * 8.0f) & 7;
+
+    set_level(id, 0, pattern[pos] * volume);
+
+    if (step <= 0.0f) return;
+
+    // hop from one duty step boundary to the next
+    float t = 0;
+
+    for (;;) {
+        float next = (pos + 1) / 8.0f;
+        float dt = (next - phase) / step;
+
+        if (t + dt >= n) {
+            phase += (n - t) * step;
+            break;
+        }
+
+        t += dt;
+        pos = (pos + 1) & 7;
+        phase = pos / 8.0f;
+
+        set_level(id, t, pattern[pos] * volume);
+    }
+
+    ch->phase = phase - (int)phase;
 }
 
-static float noise_sample(Noise *ch) {
-    if (!ch->enabled || !master_enabled) return 0.0f;
-    
-    static float last = 0.0f;
-    ch->phase += ch->freq_hz / SAMPLE_RATE;
-    
-    if (ch->phase >= 1.0f) {
-        ch->phase -= 1.0f;
-        
-        // LFSR feedback
+static void wave_span(Wave *ch, int n) {
+    if (!ch->enabled || !context.master_enabled) {
+        set_level(2, 0, 0.0f);
+        return;
+    }
+
+    float step = ch->freq_hz / synth_rate;
+    float phase = ch->phase;
+    float scale = ch->volume * 2.0f;
+    int pos = (int)(phase * 32.0f) & 31;
+
+    set_level(2, 0, (ch->waveform[pos] / 15.0f - 0.5f) * scale);
+
+    if (step <= 0.0f) return;
+
+    float t = 0;
+
+    for (;;) {
+        float next = (pos + 1) / 32.0f;
+        float dt = (next - phase) / step;
+
+        if (t + dt >= n) {
+            phase += (n - t) * step;
+            break;
+        }
+
+        t += dt;
+        pos = (pos + 1) & 31;
+        phase = pos / 32.0f;
+
+        set_level(2, t, (ch->waveform[pos] / 15.0f - 0.5f) * scale);
+    }
+
+    ch->phase = phase - (int)phase;
+}
+
+static void noise_span(Noise *ch, int n) {
+    if (!ch->enabled || !context.master_enabled) {
+        set_level(3, 0, 0.0f);
+        return;
+    }
+
+    set_level(3, 0, context.noise_last);
+
+    float step = ch->freq_hz / synth_rate;
+    if (step <= 0.0f) return;
+
+    // clock the LFSR at its own rate, which can be several times per sample
+    float t = (1.0f - ch->phase) / step;
+
+    while (t < n) {
         int bit = ((ch->lfsr >> 0) ^ (ch->lfsr >> 1)) & 1;
         ch->lfsr = (ch->lfsr >> 1) | (bit << 14);
-        
+
         if (ch->width_mode) {
             ch->lfsr &= ~(1 << 6);
             ch->lfsr |= bit << 6;
         }
-        
-        last = (ch->lfsr & 1) ? 0.0f : ch->volume;
+
+        context.noise_last = (ch->lfsr & 1) ? 0.0f : ch->volume;
+        set_level(3, t, context.noise_last);
+
+        t += 1.0f / step;
     }
-    
-    return last;
+
+    // phase left over towards the next clock
+    ch->phase = 1.0f - (t - n) * step;
 }
 
 void apu_init(void) {
-    memset(apu_regs, 0, sizeof(apu_regs));
-    memset(&ch1, 0, sizeof(ch1));
-    memset(&ch2, 0, sizeof(ch2));
-    memset(&ch3, 0, sizeof(ch3));
-    memset(&ch4, 0, sizeof(ch4));
+    memset(context.regs, 0, sizeof(context.regs));
+    memset(&context.ch1, 0, sizeof(context.ch1));
+    memset(&context.ch2, 0, sizeof(context.ch2));
+    memset(&context.ch3, 0, sizeof(context.ch3));
+    memset(&context.ch4, 0, sizeof(context.ch4));
     
-    ch1.volume = 0.0f;
-    ch2.volume = 0.0f;
-    ch3.volume = 0.5f;
-    ch4.volume = 0.0f;
-    ch4.lfsr = 0x7FFF;
+    context.ch1.volume = 0.0f;
+    context.ch2.volume = 0.0f;
+    context.ch3.volume = 0.5f;
+    context.ch4.volume = 0.0f;
+    context.ch4.lfsr = 0x7FFF;
     
     // Initialize default wave pattern
     for (int i = 0; i < 16; i++) {
-        ch3.waveform[i * 2] = (i < 8) ? 0 : 15;
-        ch3.waveform[i * 2 + 1] = (i < 8) ? 0 : 15;
+        context.ch3.waveform[i * 2] = (i < 8) ? 0 : 15;
+        context.ch3.waveform[i * 2 + 1] = (i < 8) ? 0 : 15;
     }
-    
+
+    context.master_enabled = 1;
+    context.master_volume_left = 1.0f;
+    context.master_volume_right = 1.0f;
+
+    // NR50/NR51 as the boot rom leaves them
+    context.regs[0x14] = 0x77;
+    context.regs[0x15] = 0xF3;
+
+    context.frame_sequencer = 0;
+    context.frame_sequencer_counter = 0;
+    context.sample_acc = 0;
+    context.noise_last = 0.0f;
+    memset(context.amp, 0, sizeof(context.amp));
+    blip_clear(&context.blip[0]);
+    blip_clear(&context.blip[1]);
+    context.log_len = 0;
+    context.last_tick = emu_get_context()->ticks;
+    sched_add(EV_APU, context.last_tick + GB_CPU_HZ / 512);
+}
+
+bool apu_audio_init(u32 rate) {
     if (SDL_Init(SDL_INIT_AUDIO) < 0) {
         fprintf(stderr, "SDL_Init failed: %s\n", SDL_GetError());
-        return;
+        return false;
     }
     
-    audio_mutex = SDL_CreateMutex();
-    
     SDL_AudioSpec want, have;
     SDL_zero(want);
-    want.freq = SAMPLE_RATE;
+    want.freq = rate ? rate : DEFAULT_SAMPLE_RATE;
     want.format = AUDIO_F32SYS;
-    want.channels = 1;
+    want.channels = 2;
     want.samples = 512;
     want.callback = audio_callback;
     
     audio_dev = SDL_OpenAudioDevice(NULL, 0, &want, &have, 0);
     if (!audio_dev) {
         fprintf(stderr, "SDL_OpenAudioDevice failed: %s\n", SDL_GetError());
-        return;
+        return false;
     }
     
-    // Pre-fill buffer with silence
-    for (int i = 0; i < BUFFER_SIZE; i++) {
-        audio_buffer[i] = 0.0f;
-    }
+    atomic_store(&read_pos, 0);
+    atomic_store(&write_pos, 0);
+    audio_batch_len = 0;
+
+    // SDL converts if the hardware runs at another rate
+    audio_rate = want.freq;
+    synth_rate = audio_rate;
+
+    // three device buffers queued, enough to ride out a late frame
+    audio_target = have.samples * 3;
+    if (audio_target < audio_rate / 60) audio_target = audio_rate / 60;
+    if (audio_target > BUFFER_SIZE / 4) audio_target = BUFFER_SIZE / 4;
     
     SDL_PauseAudioDevice(audio_dev, 0);
-    printf("APU initialized\n");
+    printf("APU initialized (%u Hz stereo)\n", audio_rate);
+    return true;
+}
+
+void apu_audio_wait(void) {
+    if (!audio_dev) return;
+
+    // aim half a frame under the target so the fill averages out on it
+    u32 target = audio_target - audio_rate / 120;
+    u32 fill = ring_fill();
+
+    if (fill > target) {
+        usleep((u64)(fill - target) * 1000000 / audio_rate);
+    }
 }
 
 void apu_quit(void) {
     if (audio_dev) SDL_CloseAudioDevice(audio_dev);
-    if (audio_mutex) SDL_DestroyMutex(audio_mutex);
     SDL_QuitSubSystem(SDL_INIT_AUDIO);
 }
 
 // --- Step ---
-void apu_step(int cycles) {
-    static double acc = 0;
-    acc += cycles;
-    
-    // Frame sequencer (512 Hz)
-    frame_sequencer_counter += cycles;
-    if (frame_sequencer_counter >= GB_CPU_HZ / 512) {
-        frame_sequencer_counter -= GB_CPU_HZ / 512;
-        frame_sequencer = (frame_sequencer + 1) & 7;
-        
-        // Clock length counters at 256 Hz (every other frame)
-        if ((frame_sequencer & 1) == 0) {
-            update_length(&ch1);
-            update_length(&ch2);
-            update_length_wave(&ch3);
-            update_length_noise(&ch4);
-        }
-        
-        // Clock sweep at 128 Hz (frames 2 and 6)
-        if (frame_sequencer == 2 || frame_sequencer == 6) {
-            update_sweep(&ch1);
-        }
-        
-        // Clock envelopes at 64 Hz (frame 7)
-        if (frame_sequencer == 7) {
-            update_envelope(&ch1);
-            update_envelope(&ch2);
-            update_envelope_noise(&ch4);
+static void apu_render(int cycles) {
+    context.sample_acc += cycles;
+
+    // Nothing to render into without an output device (headless)
+    if (!audio_dev) {
+        context.sample_acc = 0;
+        return;
+    }
+
+    // fuller than the target means fewer samples per emulated second
+    double error = ((double)ring_fill() - audio_target) / audio_target;
+    if (error > 1.0) error = 1.0;
+    if (error < -1.0) error = -1.0;
+
+    synth_rate = audio_rate / (1.0 + DRC_MAX_DELTA * error);
+
+    double cycles_per_sample = GB_CPU_HZ / synth_rate;
+    int samples = (int)(context.sample_acc / cycles_per_sample);
+    context.sample_acc -= samples * cycles_per_sample;
+
+    float left[BLIP_SIZE], right[BLIP_SIZE];
+    float out[BLIP_SIZE * 2];
+
+    while (samples > 0) {
+        int n = samples < BLIP_SIZE ? samples : BLIP_SIZE;
+        samples -= n;
+
+        // muted channels are held at zero
+        if (!dbg_mute_ch1) square_span(0, &context.ch1, n); else set_level(0, 0, 0.0f);
+        if (!dbg_mute_ch2) square_span(1, &context.ch2, n); else set_level(1, 0, 0.0f);
+        if (!dbg_mute_ch3) wave_span(&context.ch3, n); else set_level(2, 0, 0.0f);
+        if (!dbg_mute_ch4) noise_span(&context.ch4, n); else set_level(3, 0, 0.0f);
+
+        // Mix and interleave the two sides
+        blip_read(&context.blip[0], left, n, 0.25f);
+        blip_read(&context.blip[1], right, n, 0.25f);
+
+        for (int i = 0; i < n; i++) {
+            out[i * 2] = left[i];
+            out[i * 2 + 1] = right[i];
         }
+
+        enqueue_samples(out, n * 2);
     }
+}
+
+static void frame_sequencer_step(void) {
+    context.frame_sequencer = (context.frame_sequencer + 1) & 7;
     
-    double cycles_per_sample = (double)GB_CPU_HZ / SAMPLE_RATE;
-    while (acc >= cycles_per_sample) {
-        acc -= cycles_per_sample;
-        
-        float s = 0.0f;
-        if (!dbg_mute_ch1) s += square_sample(&ch1);
-        if (!dbg_mute_ch2) s += square_sample(&ch2);
-        if (!dbg_mute_ch3) s += wave_sample(&ch3);
-        if (!dbg_mute_ch4) s += noise_sample(&ch4);
-        
-        // Mix and apply master volume
-        s *= 0.25f;
-        
-        SDL_LockMutex(audio_mutex);
-        enqueue_sample(s);
-        SDL_UnlockMutex(audio_mutex);
+    // Clock length counters at 256 Hz (every other frame)
+    if ((context.frame_sequencer & 1) == 0) {
+        update_length(&context.ch1);
+        update_length(&context.ch2);
+        update_length_wave(&context.ch3);
+        update_length_noise(&context.ch4);
+    }
+    
+    // Clock sweep at 128 Hz (frames 2 and 6)
+    if (context.frame_sequencer == 2 || context.frame_sequencer == 6) {
+        update_sweep(&context.ch1);
+    }
+    
+    // Clock envelopes at 64 Hz (frame 7)
+    if (context.frame_sequencer == 7) {
+        update_envelope(&context.ch1);
+        update_envelope(&context.ch2);
+        update_envelope_noise(&context.ch4);
+    }
+}
+
+void apu_step(int cycles) {
+    // Render up to each frame sequencer step (512 Hz) before clocking it
+    while (context.frame_sequencer_counter + cycles >= GB_CPU_HZ / 512) {
+        int span = GB_CPU_HZ / 512 - context.frame_sequencer_counter;
+
+        apu_render(span);
+        cycles -= span;
+        context.frame_sequencer_counter = 0;
+
+        frame_sequencer_step();
+    }
+
+    apu_render(cycles);
+    context.frame_sequencer_counter += cycles;
+}
+
+static void apu_apply(u16 addr, u8 val);
+
+// Catch the APU up to the current emu tick, applying queued writes in order
+static void apu_sync(u64 now) {
+    for (u32 i = 0; i < context.log_len; i++) {
+        apu_write_entry *e = &context.log[i];
+
+        if (e->tick > context.last_tick) {
+            apu_step((int)(e->tick - context.last_tick));
+            context.last_tick = e->tick;
+        }
+
+        apu_apply(e->address, e->value);
     }
+
+    context.log_len = 0;
+
+    if (now > context.last_tick) {
+        apu_step((int)(now - context.last_tick));
+        context.last_tick = now;
+    }
+}
+
+void apu_event(u64 now) {
+    apu_sync(now);
+    sched_add(EV_APU, now + (GB_CPU_HZ / 512 - context.frame_sequencer_counter));
 }
 
 // --- Read / Write ---
 uint8_t apu_read(uint16_t addr) {
+    apu_sync(emu_get_context()->ticks);
+
     if (addr >= 0xFF10 && addr <= 0xFF3F) {
         // Some registers are write-only or have unused bits
-        if (addr == 0xFF10) return apu_regs[addr - 0xFF10] | 0x80;
-        if (addr == 0xFF11 || addr == 0xFF16) return apu_regs[addr - 0xFF10] | 0x3F;
+        if (addr == 0xFF10) return context.regs[addr - 0xFF10] | 0x80;
+        if (addr == 0xFF11 || addr == 0xFF16) return context.regs[addr - 0xFF10] | 0x3F;
         if (addr == 0xFF13 || addr == 0xFF18 || addr == 0xFF1B || addr == 0xFF1D || addr == 0xFF20) return 0xFF;
-        if (addr == 0xFF14 || addr == 0xFF19 || addr == 0xFF1E || addr == 0xFF23) return apu_regs[addr - 0xFF10] | 0xBF;
+        if (addr == 0xFF14 || addr == 0xFF19 || addr == 0xFF1E || addr == 0xFF23) return context.regs[addr - 0xFF10] | 0xBF;
         if (addr == 0xFF15) return 0xFF;
-        if (addr == 0xFF1A) return apu_regs[addr - 0xFF10] | 0x7F;
-        if (addr == 0xFF1C) return apu_regs[addr - 0xFF10] | 0x9F;
+        if (addr == 0xFF1A) return context.regs[addr - 0xFF10] | 0x7F;
+        if (addr == 0xFF1C) return context.regs[addr - 0xFF10] | 0x9F;
         if (addr == 0xFF1F) return 0xFF;
-        if (addr == 0xFF26) return (master_enabled ? 0x80 : 0) | (ch1.enabled ? 1 : 0) | (ch2.enabled ? 2 : 0) | (ch3.enabled ? 4 : 0) | (ch4.enabled ? 8 : 0) | 0x70;
+        if (addr == 0xFF26) return (context.master_enabled ? 0x80 : 0) | (context.ch1.enabled ? 1 : 0) | (context.ch2.enabled ? 2 : 0) | (context.ch3.enabled ? 4 : 0) | (context.ch4.enabled ? 8 : 0) | 0x70;
         if (addr >= 0xFF27 && addr <= 0xFF2F) return 0xFF;
-        return apu_regs[addr - 0xFF10];
+        return context.regs[addr - 0xFF10];
     }
     return 0xFF;
 }
 
 void apu_write(uint16_t addr, uint8_t val) {
     if (addr < 0xFF10 || addr > 0xFF3F) return;
-    
+
+    u64 now = emu_get_context()->ticks;
+
+    if (context.log_len == APU_LOG_SIZE) {
+        apu_sync(now);
+    }
+
+    context.log[context.log_len++] = (apu_write_entry){now, addr, val};
+}
+
+static void apu_apply(u16 addr, u8 val) {
     // Check if APU is enabled (except for wave RAM and length counters)
-    if (!master_enabled && addr != 0xFF26 && !(addr >= 0xFF30 && addr <= 0xFF3F)) {
+    if (!context.master_enabled && addr != 0xFF26 && !(addr >= 0xFF30 && addr <= 0xFF3F)) {
         // Only length counters can be written while disabled
         if (addr != 0xFF11 && addr != 0xFF16 && addr != 0xFF1B && addr != 0xFF20) {
             return;
         }
     }
     
-    apu_regs[addr - 0xFF10] = val;
+    context.regs[addr - 0xFF10] = val;
     
     // --- Channel 1 (Square with sweep) ---
     if (addr == 0xFF10) {
         // Sweep
-        ch1.sweep_period = (val >> 4) & 7;
-        ch1.sweep_direction = (val >> 3) & 1;
-        ch1.sweep_shift = val & 7;
+        context.ch1.sweep_period = (val >> 4) & 7;
+        context.ch1.sweep_direction = (val >> 3) & 1;
+        context.ch1.sweep_shift = val & 7;
     }
     if (addr == 0xFF11) {
         // Duty & Length
-        ch1.duty = ((val >> 6) & 3) / 3.0f;
-        ch1.length_counter = 64 - (val & 0x3F);
+        context.ch1.duty = ((val >> 6) & 3) / 3.0f;
+        context.ch1.length_counter = 64 - (val & 0x3F);
     }
     if (addr == 0xFF12) {
         // Envelope
-        ch1.env_initial_volume = (val >> 4) & 0xF;
-        ch1.env_direction = (val >> 3) & 1;
-        ch1.env_period = val & 7;
-        if ((val & 0xF8) == 0) ch1.enabled = 0;
+        context.ch1.env_initial_volume = (val >> 4) & 0xF;
+        context.ch1.env_direction = (val >> 3) & 1;
+        context.ch1.env_period = val & 7;
+        if ((val & 0xF8) == 0) context.ch1.enabled = 0;
     }
     if (addr == 0xFF13 || addr == 0xFF14) {
-        uint16_t freq = (uint16_t)apu_regs[0x03] | ((uint16_t)(apu_regs[0x04] & 7) << 8);
-        ch1.freq_hz = 131072.0f / (2048 - freq);
-        ch1.sweep_frequency = freq;
+        uint16_t freq = (uint16_t)context.regs[0x03] | ((uint16_t)(context.regs[0x04] & 7) << 8);
+        context.ch1.freq_hz = 131072.0f / (2048 - freq);
+        context.ch1.sweep_frequency = freq;
         
         if (addr == 0xFF14) {
-            ch1.length_enabled = (val >> 6) & 1;
+            context.ch1.length_enabled = (val >> 6) & 1;
             if (val & 0x80) {
                 // Trigger
-                ch1.enabled = 1;
-                ch1.phase = 0;
-                ch1.env_volume = ch1.env_initial_volume;
-                ch1.volume = ch1.env_volume / 15.0f;
-                ch1.env_timer = ch1.env_period * (GB_CPU_HZ / 64);
-                ch1.sweep_timer = ch1.sweep_period * (GB_CPU_HZ / 128);
-                if (ch1.length_counter == 0) ch1.length_counter = 64;
-                if ((apu_regs[0x02] & 0xF8) == 0) ch1.enabled = 0;
+                context.ch1.enabled = 1;
+                context.ch1.phase = 0;
+                context.ch1.env_volume = context.ch1.env_initial_volume;
+                context.ch1.volume = context.ch1.env_volume / 15.0f;
+                context.ch1.env_timer = context.ch1.env_period * (GB_CPU_HZ / 64);
+                context.ch1.sweep_timer = context.ch1.sweep_period * (GB_CPU_HZ / 128);
+                if (context.ch1.length_counter == 0) context.ch1.length_counter = 64;
+                if ((context.regs[0x02] & 0xF8) == 0) context.ch1.enabled = 0;
             }
         }
     }
@@ -452,31 +650,31 @@ void apu_write(uint16_t addr, uint8_t val) {
     // --- Channel 2 (Square) ---
     if (addr == 0xFF16) {
         // Duty & Length
-        ch2.duty = ((val >> 6) & 3) / 3.0f;
-        ch2.length_counter = 64 - (val & 0x3F);
+        context.ch2.duty = ((val >> 6) & 3) / 3.0f;
+        context.ch2.length_counter = 64 - (val & 0x3F);
     }
     if (addr == 0xFF17) {
         // Envelope
-        ch2.env_initial_volume = (val >> 4) & 0xF;
-        ch2.env_direction = (val >> 3) & 1;
-        ch2.env_period = val & 7;
-        if ((val & 0xF8) == 0) ch2.enabled = 0;
+        context.ch2.env_initial_volume = (val >> 4) & 0xF;
+        context.ch2.env_direction = (val >> 3) & 1;
+        context.ch2.env_period = val & 7;
+        if ((val & 0xF8) == 0) context.ch2.enabled = 0;
     }
     if (addr == 0xFF18 || addr == 0xFF19) {
-        uint16_t freq = (uint16_t)apu_regs[0x08] | ((uint16_t)(apu_regs[0x09] & 7) << 8);
-        ch2.freq_hz = 131072.0f / (2048 - freq);
+        uint16_t freq = (uint16_t)context.regs[0x08] | ((uint16_t)(context.regs[0x09] & 7) << 8);
+        context.ch2.freq_hz = 131072.0f / (2048 - freq);
         
         if (addr == 0xFF19) {
-            ch2.length_enabled = (val >> 6) & 1;
+            context.ch2.length_enabled = (val >> 6) & 1;
             if (val & 0x80) {
                 // Trigger
-                ch2.enabled = 1;
-                ch2.phase = 0;
-                ch2.env_volume = ch2.env_initial_volume;
-                ch2.volume = ch2.env_volume / 15.0f;
-                ch2.env_timer = ch2.env_period * (GB_CPU_HZ / 64);
-                if (ch2.length_counter == 0) ch2.length_counter = 64;
-                if ((apu_regs[0x07] & 0xF8) == 0) ch2.enabled = 0;
+                context.ch2.enabled = 1;
+                context.ch2.phase = 0;
+                context.ch2.env_volume = context.ch2.env_initial_volume;
+                context.ch2.volume = context.ch2.env_volume / 15.0f;
+                context.ch2.env_timer = context.ch2.env_period * (GB_CPU_HZ / 64);
+                if (context.ch2.length_counter == 0) context.ch2.length_counter = 64;
+                if ((context.regs[0x07] & 0xF8) == 0) context.ch2.enabled = 0;
             }
         }
     }
@@ -484,32 +682,32 @@ void apu_write(uint16_t addr, uint8_t val) {
     // --- Channel 3 (Wave) ---
     if (addr == 0xFF1A) {
         // DAC enable
-        if (!(val & 0x80)) ch3.enabled = 0;
+        if (!(val & 0x80)) context.ch3.enabled = 0;
     }
     if (addr == 0xFF1B) {
         // Length
-        ch3.length_counter = 256 - val;
+        context.ch3.length_counter = 256 - val;
     }
     if (addr == 0xFF1C) {
         // Volume
         int vol_shift = (val >> 5) & 3;
-        if (vol_shift == 0) ch3.volume = 0.0f;
-        else if (vol_shift == 1) ch3.volume = 1.0f;
-        else if (vol_shift == 2) ch3.volume = 0.5f;
-        else ch3.volume = 0.25f;
+        if (vol_shift == 0) context.ch3.volume = 0.0f;
+        else if (vol_shift == 1) context.ch3.volume = 1.0f;
+        else if (vol_shift == 2) context.ch3.volume = 0.5f;
+        else context.ch3.volume = 0.25f;
     }
     if (addr == 0xFF1D || addr == 0xFF1E) {
-        uint16_t freq = (uint16_t)apu_regs[0x0D] | ((uint16_t)(apu_regs[0x0E] & 7) << 8);
-        ch3.freq_hz = 65536.0f / (2048 - freq);
+        uint16_t freq = (uint16_t)context.regs[0x0D] | ((uint16_t)(context.regs[0x0E] & 7) << 8);
+        context.ch3.freq_hz = 65536.0f / (2048 - freq);
         
         if (addr == 0xFF1E) {
-            ch3.length_enabled = (val >> 6) & 1;
+            context.ch3.length_enabled = (val >> 6) & 1;
             if (val & 0x80) {
                 // Trigger
-                if (apu_regs[0x0A] & 0x80) {
-                    ch3.enabled = 1;
-                    ch3.phase = 0;
-                    if (ch3.length_counter == 0) ch3.length_counter = 256;
+                if (context.regs[0x0A] & 0x80) {
+                    context.ch3.enabled = 1;
+                    context.ch3.phase = 0;
+                    if (context.ch3.length_counter == 0) context.ch3.length_counter = 256;
                 }
             }
         }
@@ -517,65 +715,65 @@ void apu_write(uint16_t addr, uint8_t val) {
     if (addr >= 0xFF30 && addr <= 0xFF3F) {
         // Wave pattern RAM
         int i = (addr - 0xFF30) * 2;
-        ch3.waveform[i] = (val >> 4) & 0xF;
-        ch3.waveform[i + 1] = val & 0xF;
+        context.ch3.waveform[i] = (val >> 4) & 0xF;
+        context.ch3.waveform[i + 1] = val & 0xF;
     }
     
     // --- Channel 4 (Noise) ---
     if (addr == 0xFF20) {
         // Length
-        ch4.length_counter = 64 - (val & 0x3F);
+        context.ch4.length_counter = 64 - (val & 0x3F);
     }
     if (addr == 0xFF21) {
         // Envelope
-        ch4.env_initial_volume = (val >> 4) & 0xF;
-        ch4.env_direction = (val >> 3) & 1;
-        ch4.env_period = val & 7;
-        if ((val & 0xF8) == 0) ch4.enabled = 0;
+        context.ch4.env_initial_volume = (val >> 4) & 0xF;
+        context.ch4.env_direction = (val >> 3) & 1;
+        context.ch4.env_period = val & 7;
+        if ((val & 0xF8) == 0) context.ch4.enabled = 0;
     }
     if (addr == 0xFF22) {
         // Polynomial counter
         int shift = (val >> 4) & 0xF;
         int divisor_code = val & 7;
-        ch4.width_mode = (val >> 3) & 1;
+        context.ch4.width_mode = (val >> 3) & 1;
         
         float divisor = divisor_code ? (divisor_code * 16.0f) : 8.0f;
-        ch4.freq_hz = 524288.0f / divisor / (1 << (shift + 1));
+        context.ch4.freq_hz = 524288.0f / divisor / (1 << (shift + 1));
     }
     if (addr == 0xFF23) {
-        ch4.length_enabled = (val >> 6) & 1;
+        context.ch4.length_enabled = (val >> 6) & 1;
         if (val & 0x80) {
             // Trigger
-            ch4.enabled = 1;
-            ch4.phase = 0;
-            ch4.lfsr = 0x7FFF;
-            ch4.env_volume = ch4.env_initial_volume;
-            ch4.volume = ch4.env_volume / 15.0f;
-            ch4.env_timer = ch4.env_period * (GB_CPU_HZ / 64);
-            if (ch4.length_counter == 0) ch4.length_counter = 64;
-            if ((apu_regs[0x11] & 0xF8) == 0) ch4.enabled = 0;
+            context.ch4.enabled = 1;
+            context.ch4.phase = 0;
+            context.ch4.lfsr = 0x7FFF;
+            context.ch4.env_volume = context.ch4.env_initial_volume;
+            context.ch4.volume = context.ch4.env_volume / 15.0f;
+            context.ch4.env_timer = context.ch4.env_period * (GB_CPU_HZ / 64);
+            if (context.ch4.length_counter == 0) context.ch4.length_counter = 64;
+            if ((context.regs[0x11] & 0xF8) == 0) context.ch4.enabled = 0;
         }
     }
     
     // --- Master control ---
     if (addr == 0xFF24) {
-        // Master volume
-        master_volume_left = ((val >> 4) & 7) / 7.0f;
-        master_volume_right = (val & 7) / 7.0f;
+        // Master volume, 1/8 steps up to full. 0 is the quietest, not mute.
+        context.master_volume_left = (((val >> 4) & 7) + 1) / 8.0f;
+        context.master_volume_right = ((val & 7) + 1) / 8.0f;
     }
     if (addr == 0xFF26) {
         // Master enable
-        master_enabled = (val >> 7) & 1;
-        if (!master_enabled) {
+        context.master_enabled = (val >> 7) & 1;
+        if (!context.master_enabled) {
             // Disable all channels
-            ch1.enabled = 0;
-            ch2.enabled = 0;
-            ch3.enabled = 0;
-            ch4.enabled = 0;
+            context.ch1.enabled = 0;
+            context.ch2.enabled = 0;
+            context.ch3.enabled = 0;
+            context.ch4.enabled = 0;
             // Clear all registers except wave RAM
             for (int i = 0; i < 0x30; i++) {
                 if (i < 0x20 || i >= 0x30) {
-                    apu_regs[i] = 0;
+                    context.regs[i] = 0;
                 }
             }
         }
@@ -595,4 +793,18 @@ void apu_mute_channel(int ch, int mute) {
 void apu_log_underruns(int enable) {
     // Not used in this version
     (void)enable;
-}
\ No newline at end of file
+}
+
+void apu_serialize(state_buf *s) {
+    //channel state only, samples already queued for the device are not kept.
+    //pending writes are applied first so the log never needs saving.
+    if (!s->loading && s->data) {
+        apu_sync(emu_get_context()->ticks);
+    }
+
+    state_field(s, &context, offsetof(apu_context, log_len));
+
+    if (s->loading) {
+        context.log_len = 0;
+    }
+}
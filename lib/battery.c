@@ -0,0 +1,160 @@
+#include <battery.h>
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <windows.h>
+
+//the crt's io.h is hidden behind our own, this is all that's needed from it.
+int __cdecl _commit(int fd);
+#else
+#include <unistd.h>
+#endif
+
+struct battery_writer {
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+
+    bool pending; //image changed since it was last written.
+    bool stop;
+
+    char path[2100];
+    char temp[2108];
+    u32 size;
+    u8 *image; //staging copy filled in by the emulation thread.
+    u8 *out; //what the thread is writing, so the image stays unlocked.
+};
+
+static bool write_file(battery_writer *w) {
+    FILE *fp = fopen(w->temp, "wb");
+
+    if (!fp) {
+        fprintf(stderr, "FAILED TO OPEN: %s\n", w->temp);
+        return false;
+    }
+
+    bool ok = fwrite(w->out, w->size, 1, fp) == 1 && !fflush(fp);
+
+    //on the disk, not just handed to the os, before it can replace the save.
+#ifdef _WIN32
+    ok = ok && !_commit(_fileno(fp));
+#else
+    ok = ok && !fsync(fileno(fp));
+#endif
+
+    ok = !fclose(fp) && ok;
+
+    //only replace the old save once the new one is all there. rename
+    //won't replace a file on windows.
+#ifdef _WIN32
+    ok = ok && MoveFileExA(w->temp, w->path, MOVEFILE_REPLACE_EXISTING);
+#else
+    ok = ok && !rename(w->temp, w->path);
+#endif
+
+    if (!ok) {
+        fprintf(stderr, "FAILED TO SAVE: %s\n", w->path);
+        remove(w->temp);
+        return false;
+    }
+
+    return true;
+}
+
+static void *writer_run(void *p) {
+    battery_writer *w = p;
+
+    pthread_mutex_lock(&w->lock);
+
+    while (true) {
+        while (!w->pending && !w->stop) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+
+        if (!w->pending) {
+            break;
+        }
+
+        memcpy(w->out, w->image, w->size);
+        w->pending = false;
+
+        pthread_mutex_unlock(&w->lock);
+        write_file(w);
+        pthread_mutex_lock(&w->lock);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static void writer_free(battery_writer *w) {
+    free(w->image);
+    free(w->out);
+    free(w);
+}
+
+battery_writer *battery_writer_start(const char *path, const u8 *data, u32 size) {
+    battery_writer *w = calloc(1, sizeof(battery_writer));
+
+    if (!w) {
+        return NULL;
+    }
+
+    snprintf(w->path, sizeof(w->path), "%s", path);
+    snprintf(w->temp, sizeof(w->temp), "%s.tmp", path);
+    w->size = size;
+    w->image = malloc(size);
+    w->out = malloc(size);
+
+    if (!w->image || !w->out) {
+        writer_free(w);
+        return NULL;
+    }
+
+    memcpy(w->image, data, size);
+    pthread_mutex_init(&w->lock, NULL);
+    pthread_cond_init(&w->cond, NULL);
+
+    if (pthread_create(&w->thread, NULL, writer_run, w)) {
+        fprintf(stderr, "FAILED TO START BATTERY SAVE THREAD!\n");
+        pthread_mutex_destroy(&w->lock);
+        pthread_cond_destroy(&w->cond);
+        writer_free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+u8 *battery_writer_lock(battery_writer *w) {
+    pthread_mutex_lock(&w->lock);
+    return w->image;
+}
+
+void battery_writer_unlock(battery_writer *w, bool changed) {
+    if (changed) {
+        w->pending = true;
+        pthread_cond_signal(&w->cond);
+    }
+
+    pthread_mutex_unlock(&w->lock);
+}
+
+void battery_writer_stop(battery_writer *w) {
+    if (!w) {
+        return;
+    }
+
+    pthread_mutex_lock(&w->lock);
+    w->stop = true;
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+
+    pthread_join(w->thread, NULL);
+
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    writer_free(w);
+}
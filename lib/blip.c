@@ -0,0 +1,116 @@
+#include <blip.h>
+#include <string.h>
+#include <math.h>
+#include <pthread.h>
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// fraction of the output rate the kernel passes, just under nyquist.
+#define BLIP_CUTOFF 0.45
+
+// one impulse response per sub-sample phase, each summing to 1 so a delta
+// integrates to exactly its own height. shared by every machine.
+static _Alignas(32) float kernel[BLIP_PHASES][BLIP_TAPS];
+static pthread_once_t kernel_once = PTHREAD_ONCE_INIT;
+
+static void kernel_init() {
+    for (int p = 0; p < BLIP_PHASES; p++) {
+        double frac = (double)p / BLIP_PHASES;
+        double sum = 0;
+
+        for (int j = 0; j < BLIP_TAPS; j++) {
+            //distance from the impulse, which sits between taps 7 and 8.
+            double x = j - (BLIP_TAPS / 2 - 1) - frac;
+            double s = x == 0 ? 1.0 : sin(M_PI * 2 * BLIP_CUTOFF * x) / (M_PI * 2 * BLIP_CUTOFF * x);
+
+            //blackman window over the kernel width.
+            double w = 0.42 + 0.5 * cos(2 * M_PI * x / BLIP_TAPS) +
+                0.08 * cos(4 * M_PI * x / BLIP_TAPS);
+
+            kernel[p][j] = s * w;
+            sum += s * w;
+        }
+
+        for (int j = 0; j < BLIP_TAPS; j++) {
+            kernel[p][j] /= sum;
+        }
+    }
+}
+
+void blip_clear(blip_buffer *b) {
+    pthread_once(&kernel_once, kernel_init);
+
+    memset(b->deltas, 0, sizeof(b->deltas));
+    b->acc = 0;
+}
+
+void blip_add(blip_buffer *b, float t, float delta) {
+    int i = (int)t;
+    const float *k = kernel[(int)((t - i) * BLIP_PHASES) & (BLIP_PHASES - 1)];
+    float *d = b->deltas + i;
+
+#if defined(__AVX__)
+    __m256 v = _mm256_set1_ps(delta);
+
+    for (int j = 0; j < BLIP_TAPS; j += 8) {
+        __m256 x = _mm256_loadu_ps(d + j);
+        x = _mm256_add_ps(x, _mm256_mul_ps(_mm256_load_ps(k + j), v));
+        _mm256_storeu_ps(d + j, x);
+    }
+#elif defined(__SSE2__)
+    __m128 v = _mm_set1_ps(delta);
+
+    for (int j = 0; j < BLIP_TAPS; j += 4) {
+        __m128 x = _mm_loadu_ps(d + j);
+        x = _mm_add_ps(x, _mm_mul_ps(_mm_load_ps(k + j), v));
+        _mm_storeu_ps(d + j, x);
+    }
+#else
+    for (int j = 0; j < BLIP_TAPS; j++) {
+        d[j] += k[j] * delta;
+    }
+#endif
+}
+
+void blip_read(blip_buffer *b, float *out, int n, float gain) {
+    float acc = b->acc;
+    int i = 0;
+
+#if defined(__SSE2__)
+    //prefix sum 4 samples at a time, carrying the last lane forward.
+    __m128 carry = _mm_set1_ps(acc);
+    __m128 g = _mm_set1_ps(gain);
+    __m128 lo = _mm_set1_ps(-1.0f);
+    __m128 hi = _mm_set1_ps(1.0f);
+
+    for (; i + 4 <= n; i += 4) {
+        __m128 x = _mm_loadu_ps(b->deltas + i);
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)));
+        x = _mm_add_ps(x, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 8)));
+        x = _mm_add_ps(x, carry);
+        carry = _mm_shuffle_ps(x, x, _MM_SHUFFLE(3, 3, 3, 3));
+
+        x = _mm_min_ps(_mm_max_ps(_mm_mul_ps(x, g), lo), hi);
+        _mm_storeu_ps(out + i, x);
+    }
+
+    acc = _mm_cvtss_f32(carry);
+#endif
+
+    for (; i < n; i++) {
+        acc += b->deltas[i];
+
+        float s = acc * gain;
+        if (s > 1.0f) s = 1.0f;
+        if (s < -1.0f) s = -1.0f;
+        out[i] = s;
+    }
+
+    b->acc = acc;
+
+    //keep the kernel tails that reach past what was read.
+    memmove(b->deltas, b->deltas + n, BLIP_TAPS * sizeof(float));
+    memset(b->deltas + BLIP_TAPS, 0, n * sizeof(float));
+}
@@ -5,6 +5,7 @@
 #include <io.h>
 #include <ppu.h>
 #include <dma.h>
+#include <gb.h>
 
 // 0x0000 - 0x3FFF : ROM Bank 0
 // 0x4000 - 0x7FFF : ROM Bank 1 - Switchable
@@ -20,7 +21,22 @@
 // 0xFF00 - 0xFF7F : I/O Registers
 // 0xFF80 - 0xFFFE : Zero Page
 
-u8 bus_read(u16 address) {
+#define context (gb_cur->bus)
+
+void bus_map(u16 address, u32 size, u8 *read, u8 *write) {
+    for (u32 page = address >> 8; page < ((address + size) >> 8); page++) {
+        u32 offset = (page << 8) - address;
+
+        context.read_map[page] = read ? read + offset : NULL;
+        context.write_map[page] = write ? write + offset : NULL;
+    }
+}
+
+u8 *bus_read_page(u16 address) {
+    return context.read_map[address >> 8];
+}
+
+static u8 bus_read_slow(u16 address) {
     if (address < 0x8000) {
         //ROM Data
         return cart_read(address);
@@ -58,7 +74,7 @@ u8 bus_read(u16 address) {
     return hram_read(address);
 }
 
-void bus_write(u16 address, u8 value) {
+static void bus_write_slow(u16 address, u8 value) {
     if (address < 0x8000) {
         //ROM Data
         cart_write(address, value);
@@ -94,6 +110,27 @@ void bus_write(u16 address, u8 value) {
     }
 }
 
+u8 bus_read(u16 address) {
+    u8 *page = context.read_map[address >> 8];
+
+    if (page) {
+        return page[address & 0xFF];
+    }
+
+    return bus_read_slow(address);
+}
+
+void bus_write(u16 address, u8 value) {
+    u8 *page = context.write_map[address >> 8];
+
+    if (page) {
+        page[address & 0xFF] = value;
+        return;
+    }
+
+    bus_write_slow(address, value);
+}
+
 u16 bus_read16(u16 address) {
     u16 lo = bus_read(address);
     u16 hi = bus_read(address + 1);
@@ -1,31 +1,33 @@
 #include <cart.h>
+#include <mbc.h>
+#include <bus.h>
+#include <gb.h>
 #include <string.h>
+#include <stddef.h>
+#include <time.h>
 
-typedef struct {
-    char filename[1024];
-    u32 rom_size;
-    u8 *rom_data;
-    rom_header *header;
+#include <sys/stat.h>
 
-    //mbc1 related data
-    bool ram_enabled;
-    bool ram_banking;
+#ifdef _WIN32
+#include <direct.h>
+#include <stdint.h>
+#include <windows.h>
 
-    u8 *rom_bank_x;
-    u8 banking_mode;
+//the crt's io.h is hidden behind our own, this is all that's needed from it.
+intptr_t __cdecl _get_osfhandle(int fd);
+#else
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
-    u8 rom_bank_value;
-    u8 ram_bank_value;
 
-    u8 *ram_bank; //current selected ram bank
-    u8 *ram_banks[16]; //all ram banks
 
-    //for battery
-    bool battery; //has battery
-    bool need_save; //should save battery backup.
-} cart_context;
+#define context (gb_cur->cart)
 
-static cart_context context;
+// where battery files and the index naming them live, shared by every machine.
+static char save_dir[1024] = "../saves";
 
 // Helper: get the base filename (strips directories)
 const char* get_basename(const char* path) {
@@ -39,13 +41,14 @@ bool cart_need_save() {
     return context.need_save;
 }
 
-bool cart_mbc1() {
-    return BETWEEN(context.header->type, 1, 3);
-}
-
 bool cart_battery() {
-    //mbc1 only for now...
-    return context.header->type == 3;
+    switch(context.header.type) {
+        case 0x03: case 0x06: case 0x09: case 0x0D: case 0x0F:
+        case 0x10: case 0x13: case 0x1B: case 0x1E: case 0x22:
+            return true;
+    }
+
+    return false;
 }
 
 static const char *ROM_TYPES[] = {
@@ -151,71 +154,151 @@ static const char *LIC_CODE[0xA5] = {
 };
 
 const char *cart_lic_name() {
-    if (context.header->new_lic_code <= 0xA4) {
-        return LIC_CODE[context.header->lic_code];
+    if (context.header.new_lic_code <= 0xA4) {
+        return LIC_CODE[context.header.lic_code];
     }
 
     return "UNKNOWN";
 }
 
 const char *cart_type_name() {
-    if (context.header->type <= 0x22) {
-        return ROM_TYPES[context.header->type];
+    if (context.header.type <= 0x22) {
+        return ROM_TYPES[context.header.type];
     }
 
     return "UNKNOWN";
 }
 
+// cartridge ram writes stay on the slow path so battery saves get flagged.
+// clock registers and mbc2 ram aren't plain bytes and are never mapped.
+void cart_update_map() {
+    bool ram = context.ram_enabled && context.ram_bank &&
+        !context.rtc_select && !context.mapper->ram_nibbles;
+
+    bus_map(0x0000, 0x4000, context.rom_data, NULL);
+    bus_map(0x4000, 0x4000, context.rom_bank_x, NULL);
+    bus_map(0xA000, 0x2000, ram ? context.ram_bank : NULL, NULL);
+}
+
 void cart_setup_banking() {
+    //states hold every ram bank, their size is counted again.
+    emu_get_context()->state_size = 0;
+
     for (int i=0; i<16; i++) {
         context.ram_banks[i] = 0;
 
-        if ((context.header->ram_size == 2 && i == 0) ||
-            (context.header->ram_size == 3 && i < 4) || 
-            (context.header->ram_size == 4 && i < 16) || 
-            (context.header->ram_size == 5 && i < 8)) {
+        if ((context.mapper->ram_nibbles && i == 0) ||
+            (context.header.ram_size == 2 && i == 0) ||
+            (context.header.ram_size == 3 && i < 4) || 
+            (context.header.ram_size == 4 && i < 16) || 
+            (context.header.ram_size == 5 && i < 8)) {
             context.ram_banks[i] = malloc(0x2000);
             memset(context.ram_banks[i], 0, 0x2000);
         }
     }
 
     context.ram_bank = context.ram_banks[0];
+    context.ram_bank_number = 0;
+    memset(context.ram_dirty, 0, sizeof(context.ram_dirty));
+    context.rom_bank_value = 1;
     context.rom_bank_x = context.rom_data + 0x4000; //rom bank 1
+    context.ram_enabled = context.mapper->ram_open;
+
+    context.rtc_select = 0;
+    context.rtc_latch = 0xFF;
+    context.rtc_ticks = 0;
+    memset(context.rtc, 0, sizeof(context.rtc));
+    memset(context.rtc_latched, 0, sizeof(context.rtc_latched));
+
+    cart_update_map();
 }
 
-bool cart_load(char *cart) {
-    snprintf(context.filename, sizeof(context.filename), "%s", cart);
+// maps the rom file read only, so every machine and process running the
+// same game shares its pages. NULL when it can't be mapped.
+static u8 *rom_map(const char *path, u32 *size) {
+#ifndef _WIN32
+    int fd = open(path, O_RDONLY);
 
-    FILE *fp = fopen(cart, "r");
+    if (fd < 0) {
+        return NULL;
+    }
 
-    if (!fp) {
-        printf("Failed to open: %s\n", cart);
-        return false;
+    struct stat st;
+    u8 *data = NULL;
+
+    //smaller files get padded out to two banks by rom_read.
+    if (!fstat(fd, &st) && st.st_size >= 0x8000) {
+        data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (data == MAP_FAILED) {
+            data = NULL;
+        } else {
+            *size = st.st_size;
+        }
     }
 
-    printf("Opened: %s\n", context.filename);
+    close(fd);
+    return data;
+#else
+    return NULL;
+#endif
+}
 
-    fseek(fp, 0, SEEK_END);
-    context.rom_size = ftell(fp);
+static u8 *rom_read(const char *path, u32 *size) {
+    FILE *fp = fopen(path, "rb");
 
+    if (!fp) {
+        return NULL;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    long len = ftell(fp);
     rewind(fp);
 
-    context.rom_data = malloc(context.rom_size);
-    fread(context.rom_data, context.rom_size, 1, fp);
+    *size = len < 0x8000 ? 0x8000 : len;
+    u8 *data = calloc(1, *size);
+
+    if (data && len > 0 && fread(data, len, 1, fp) != 1) {
+        free(data);
+        data = NULL;
+    }
+
     fclose(fp);
+    return data;
+}
+
+bool cart_load(char *cart) {
+    snprintf(context.filename, sizeof(context.filename), "%s", cart);
+
+    context.rom_shared = false;
+    context.rom_data = rom_map(cart, &context.rom_size);
+    context.rom_mapped = context.rom_data != NULL;
+
+    if (!context.rom_data) {
+        context.rom_data = rom_read(cart, &context.rom_size);
+    }
 
-    context.header = (rom_header *)(context.rom_data + 0x100);
-    context.header->title[15] = 0;
+    if (!context.rom_data) {
+        printf("Failed to open: %s\n", cart);
+        return false;
+    }
+
+    printf("Opened: %s\n", context.filename);
+
+    //the rom stays read only, the title is terminated in a copy.
+    memcpy(&context.header, context.rom_data + 0x100, sizeof(context.header));
+    context.header.title[15] = 0;
+    context.mapper = mbc_for_type(context.header.type);
     context.battery = cart_battery();
     context.need_save = false;
 
     printf("Cartridge Loaded:\n");
-    printf("\t Title    : %s\n", context.header->title);
-    printf("\t Type     : %2.2X (%s)\n", context.header->type, cart_type_name());
-    printf("\t ROM Size : %d KB\n", 32 << context.header->rom_size);
-    printf("\t RAM Size : %2.2X\n", context.header->ram_size);
-    printf("\t LIC Code : %2.2X (%s)\n", context.header->lic_code, cart_lic_name());
-    printf("\t ROM Vers : %2.2X\n", context.header->version);
+    printf("\t Title    : %s\n", context.header.title);
+    printf("\t Type     : %2.2X (%s)\n", context.header.type, cart_type_name());
+    printf("\t ROM Size : %d KB\n", 32 << context.header.rom_size);
+    printf("\t RAM Size : %2.2X\n", context.header.ram_size);
+    printf("\t LIC Code : %2.2X (%s)\n", context.header.lic_code, cart_lic_name());
+    printf("\t ROM Vers : %2.2X\n", context.header.version);
 
     cart_setup_banking();
 
@@ -224,7 +307,7 @@ bool cart_load(char *cart) {
         x = x - context.rom_data[i] - 1;
     }
 
-    printf("\t Checksum : %2.2X (%s)\n", context.header->checksum, (x & 0xFF) ? "PASSED" : "FAILED");
+    printf("\t Checksum : %2.2X (%s)\n", context.header.checksum, (x & 0xFF) ? "PASSED" : "FAILED");
 
     if (context.battery) {
         cart_battery_load();
@@ -233,124 +316,334 @@ bool cart_load(char *cart) {
     return true;
 }
 
-void cart_battery_load() {
-    if (!context.ram_bank) {
-        return;
+void cart_attach(cart_context *src) {
+    snprintf(context.filename, sizeof(context.filename), "%s", src->filename);
+
+    context.rom_size = src->rom_size;
+    context.rom_data = src->rom_data;
+    context.rom_shared = true;
+    context.rom_mapped = false;
+    context.header = src->header;
+    context.mapper = src->mapper;
+    context.battery = false;
+    context.battery_writer = NULL;
+    context.need_save = false;
+
+    cart_setup_banking();
+}
+
+void cart_free(cart_context *cart) {
+    if (cart->battery_writer) {
+        //pages written since the last save go out before the writer stops.
+        //saving works on the selected machine, so select the cart's own.
+        gb_t *prev = gb_cur;
+        gb_select((gb_t *)((u8 *)cart - offsetof(gb_t, cart)));
+        cart_battery_close();
+        gb_select(prev);
     }
 
-    char fn[1048];
-    sprintf(fn, "../saves/%s.battery", get_basename(context.filename));
+    for (int i=0; i<16; i++) {
+        free(cart->ram_banks[i]);
+        cart->ram_banks[i] = NULL;
+    }
 
-    FILE *fp = fopen(fn, "rb");
-    if (!fp) {
-        fprintf(stderr, "FAILED TO OPEN: %s\n", fn);
-        return;
+    //a shared rom is released by the machine that loaded it.
+    if (!cart->rom_shared && cart->rom_mapped) {
+#ifndef _WIN32
+        munmap(cart->rom_data, cart->rom_size);
+#endif
+    } else if (!cart->rom_shared) {
+        free(cart->rom_data);
     }
 
-    fread(context.ram_bank, 0x2000, 1, fp);
-    fclose(fp);
+    cart->rom_data = NULL;
 }
 
-void cart_battery_save() {
-    if (!context.ram_bank) {
-        return;
+// the battery file holds every ram bank in order, then for carts with a
+// clock its registers, the latched copy and the host time it was saved at.
+#define RTC_SAVE_SIZE 18
+
+static bool cart_rtc() {
+    return context.header.type == 0x0F || context.header.type == 0x10;
+}
+
+static u32 cart_ram_count() {
+    u32 banks = 0;
+
+    while (banks < 16 && context.ram_banks[banks]) {
+        banks++;
     }
 
-    char fn[1048];
-    sprintf(fn, "../saves/%s.battery", get_basename(context.filename));
-    FILE *fp = fopen(fn, "wb");
+    return banks;
+}
+
+static void rtc_save(u8 *out) {
+    mbc_rtc_update();
 
-    if (!fp) {
-        fprintf(stderr, "FAILED TO OPEN: %s\n", fn);
-        return;
+    u64 now = time(NULL);
+    memcpy(out, context.rtc, 5);
+    memcpy(out + 5, context.rtc_latched, 5);
+
+    for (int i=0; i<8; i++) {
+        out[10 + i] = now >> (i * 8);
     }
+}
 
-    fwrite(context.ram_bank, 0x2000, 1, fp);
-    fclose(fp);
+static void rtc_load(const u8 *in) {
+    u64 then = 0;
+    u64 now = time(NULL);
+
+    memcpy(context.rtc, in, 5);
+    memcpy(context.rtc_latched, in + 5, 5);
+
+    for (int i=0; i<8; i++) {
+        then |= (u64)in[10 + i] << (i * 8);
+    }
+
+    //the clock kept going while the emulator was closed.
+    if (now > then) {
+        mbc_rtc_add(now - then);
+    }
 }
 
-u8 cart_read(u16 address) {
-    if (!cart_mbc1() || address < 0x4000) {
-        return context.rom_data[address];
+void cart_set_save_dir(const char *dir) {
+    snprintf(save_dir, sizeof(save_dir), "%s", dir);
+}
+
+// held across looking a game up in the index and adding it, so instances
+// starting together can't both hand out the same name.
+static void index_lock(FILE *fp, bool lock) {
+#ifdef _WIN32
+    HANDLE h = (HANDLE)_get_osfhandle(_fileno(fp));
+    OVERLAPPED o = {0};
+
+    if (lock) {
+        LockFileEx(h, LOCKFILE_EXCLUSIVE_LOCK, 0, MAXDWORD, MAXDWORD, &o);
+    } else {
+        UnlockFileEx(h, 0, MAXDWORD, MAXDWORD, &o);
+    }
+#else
+    flock(fileno(fp), lock ? LOCK_EX : LOCK_UN);
+#endif
+}
+
+// fnv-1a over the whole rom, tells apart games that share a header checksum.
+static u32 rom_hash() {
+    u32 hash = 2166136261u;
+
+    for (u32 i=0; i<context.rom_size; i++) {
+        hash = (hash ^ context.rom_data[i]) * 16777619u;
     }
 
-    if ((address & 0xE000) == 0xA000) {
-        if (!context.ram_enabled) {
-            return 0xFF;
+    return hash;
+}
+
+// the index has a "checksum hash file" line per game, so saves are found by
+// what's in the rom rather than what it's called. the header checksum alone
+// isn't enough, homebrew often leaves it at 0. games not in it yet get the
+// usual <rom>.battery name, or one with the checksum and then the hash
+// added when that name already belongs to another game.
+static void cart_find_save(char *path, size_t size) {
+    u16 checksum = cart_global_checksum();
+    u32 hash = rom_hash();
+    const char *base = get_basename(context.filename);
+    char index[1048];
+    char names[3][1060];
+    char line[1100];
+    char file[1060];
+    unsigned key;
+    unsigned key_hash;
+    bool taken[3] = {false};
+
+    snprintf(index, sizeof(index), "%s/index.txt", save_dir);
+    snprintf(names[0], sizeof(names[0]), "%s.battery", base);
+    snprintf(names[1], sizeof(names[1]), "%s-%04X.battery", base, checksum);
+    snprintf(names[2], sizeof(names[2]), "%s-%04X-%08X.battery", base, checksum, hash);
+
+    FILE *fp = fopen(index, "a+");
+
+    if (!fp) {
+        snprintf(path, size, "%s/%s", save_dir, names[0]);
+        return;
+    }
+
+    index_lock(fp, true);
+    rewind(fp);
+
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "%x %x %1059[^\r\n]", &key, &key_hash, file) != 3) {
+            //lines from before the hash was kept only hold on to their name.
+            if (sscanf(line, "%x %1059[^\r\n]", &key, file) != 2) {
+                continue;
+            }
+        } else if (key == checksum && key_hash == hash) {
+            index_lock(fp, false);
+            fclose(fp);
+            snprintf(path, size, "%s/%s", save_dir, file);
+            return;
         }
 
-        if (!context.ram_bank) {
-            return 0xFF;
+        for (int i=0; i<3; i++) {
+            taken[i] |= !strcmp(file, names[i]);
         }
+    }
+
+    //the last name has the whole key in it, nothing else can hold it.
+    int pick = 0;
 
-        return context.ram_bank[address - 0xA000];
+    while (pick < 2 && taken[pick]) {
+        pick++;
     }
 
-    return context.rom_bank_x[address - 0x4000];
+    strcpy(file, names[pick]);
+
+    fseek(fp, 0, SEEK_END);
+    fprintf(fp, "%04X %08X %s\n", checksum, hash, file);
+    fflush(fp);
+
+    index_lock(fp, false);
+    fclose(fp);
+
+    snprintf(path, size, "%s/%s", save_dir, file);
 }
 
-void cart_write(u16 address, u8 value) {
-    if (!cart_mbc1()) {
+void cart_battery_load() {
+    u32 ram_size = cart_ram_count() * 0x2000;
+    u32 size = ram_size + (cart_rtc() ? RTC_SAVE_SIZE : 0);
+
+    if (!size) {
         return;
     }
 
-    if (address < 0x2000) {
-        context.ram_enabled = ((value & 0xF) == 0xA);
+#ifdef _WIN32
+    _mkdir(save_dir);
+#else
+    mkdir(save_dir, 0755);
+#endif
+
+    cart_find_save(context.save_path, sizeof(context.save_path));
+    char *fn = context.save_path;
+
+    u8 *image = calloc(1, size);
+    size_t len = 0;
+    FILE *fp = fopen(fn, "rb");
+
+    if (fp) {
+        //older saves only hold the first bank, whatever is there gets used.
+        len = fread(image, 1, size, fp);
+        fclose(fp);
+    } else {
+        fprintf(stderr, "FAILED TO OPEN: %s\n", fn);
     }
 
-    if ((address & 0xE000) == 0x2000) {
-        //rom bank number
-        if (value == 0) {
-            value = 1;
-        }
+    for (u32 i=0; i<ram_size / 0x2000; i++) {
+        memcpy(context.ram_banks[i], image + i * 0x2000, 0x2000);
+    }
 
-        value &= 0b11111;
+    if (cart_rtc() && len == size) {
+        rtc_load(image + ram_size);
+    }
+
+    context.battery_writer = battery_writer_start(fn, image, size);
+    free(image);
+}
 
-        context.rom_bank_value = value;
-        context.rom_bank_x = context.rom_data + (0x4000 * context.rom_bank_value);
+void cart_battery_save() {
+    if (!context.battery_writer) {
+        return;
     }
 
-    if ((address & 0xE000) == 0x4000) {
-        //ram bank number
-        context.ram_bank_value = value & 0b11;
+    u32 banks = cart_ram_count();
+    u8 *image = battery_writer_lock(context.battery_writer);
 
-        if (context.ram_banking) {
-            if (cart_need_save()) {
-                cart_battery_save();
+    //only the pages written since last time are copied over.
+    for (u32 i=0; i<banks; i++) {
+        for (int page=0; context.ram_dirty[i]; page++) {
+            if (context.ram_dirty[i] & (1u << page)) {
+                memcpy(image + i * 0x2000 + page * 0x100,
+                    context.ram_banks[i] + page * 0x100, 0x100);
+                context.ram_dirty[i] &= ~(1u << page);
             }
-
-            context.ram_bank = context.ram_banks[context.ram_bank_value];
         }
     }
 
-    if ((address & 0xE000) == 0x6000) {
-        //banking mode select
-        context.banking_mode = value & 1;
+    if (cart_rtc()) {
+        rtc_save(image + banks * 0x2000);
+    }
 
-        context.ram_banking = context.banking_mode;
+    battery_writer_unlock(context.battery_writer, true);
+    context.need_save = false;
+}
 
-        if (context.ram_banking) {
-            if (cart_need_save()) {
-                cart_battery_save();
-            }
-            
-            context.ram_bank = context.ram_banks[context.ram_bank_value];
-        }
+void cart_battery_close() {
+    if (cart_need_save()) {
+        cart_battery_save();
     }
 
-    if ((address & 0xE000) == 0xA000) {
-        if (!context.ram_enabled) {
-            return;
+    battery_writer_stop(context.battery_writer);
+    context.battery_writer = NULL;
+}
+
+u8 cart_read(u16 address) {
+    return context.mapper->read(address);
+}
+
+u16 cart_rom_bank() {
+    return (context.rom_bank_x - context.rom_data) / 0x4000;
+}
+
+void cart_write(u16 address, u8 value) {
+    context.mapper->write(address, value);
+}
+
+void cart_serialize(state_buf *s) {
+    //banks are stored as numbers, the rom itself is not part of the state.
+    u16 rom_bank = (context.rom_bank_x - context.rom_data) / 0x4000;
+    int ram_bank = -1;
+
+    for (int i=0; i<16; i++) {
+        if (context.ram_bank && context.ram_bank == context.ram_banks[i]) {
+            ram_bank = i;
+            break;
         }
+    }
 
-        if (!context.ram_bank) {
-            return;
+    STATE_FIELD(s, context.ram_enabled);
+    STATE_FIELD(s, context.ram_banking);
+    STATE_FIELD(s, context.banking_mode);
+    STATE_FIELD(s, context.rom_bank_value);
+    STATE_FIELD(s, context.ram_bank_value);
+    STATE_FIELD(s, context.need_save);
+    STATE_FIELD(s, rom_bank);
+    STATE_FIELD(s, ram_bank);
+    STATE_FIELD(s, context.rtc_select);
+    STATE_FIELD(s, context.rtc);
+    STATE_FIELD(s, context.rtc_latched);
+    STATE_FIELD(s, context.rtc_latch);
+    STATE_FIELD(s, context.rtc_ticks);
+
+    for (int i=0; i<16; i++) {
+        if (context.ram_banks[i]) {
+            state_field(s, context.ram_banks[i], 0x2000);
         }
+    }
 
-        context.ram_bank[address - 0xA000] = value;
+    if (s->loading) {
+        context.rom_bank_x = context.rom_data + 0x4000 * rom_bank;
+        context.ram_bank = ram_bank >= 0 ? context.ram_banks[ram_bank] : NULL;
+        context.ram_bank_number = ram_bank >= 0 ? ram_bank : 0;
 
+        //all of ram may have changed, it goes to the battery file in full.
         if (context.battery) {
+            memset(context.ram_dirty, 0xFF, sizeof(context.ram_dirty));
             context.need_save = true;
         }
+
+        cart_update_map();
     }
-}
\ No newline at end of file
+}
+
+// checksum of the loaded rom, save states only load into the same game.
+u16 cart_global_checksum() {
+    return context.header.global_checksum;
+}
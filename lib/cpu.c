@@ -4,8 +4,9 @@
 #include <interrupts.h>
 #include <dbg.h>
 #include <timer.h>
+#include <gb.h>
 
-cpu_context context = {0};
+#define context (gb_cur->cpu)
 
 #define CPU_DEBUG 0
 
@@ -20,23 +21,30 @@ void cpu_init() {
     context.int_flags = 0;
     context.int_master_enabled = false;
     context.enabling_ime = false;
+    context.cur_op = NULL;
 
     timer_get_context()->div = 0xABCC;
+
+    cpu_cache_init();
 }
 
 static void fetch_instruction() {
+    context.cur_op = cpu_cache_fetch(context.regs.pc);
+
+    if (context.cur_op) {
+        context.cur_opcode = context.cur_op->opcode;
+        context.cur_inst = context.cur_op->inst;
+        context.regs.pc++;
+        return;
+    }
+
     context.cur_opcode = bus_read(context.regs.pc++);
     context.cur_inst = instruction_by_opcode(context.cur_opcode);
 }
 
-void fetch_data();
-
 static void execute() {
-    IN_PROC proc = inst_get_processor(context.cur_inst->type);
-
-    if (!proc) {
-        NO_IMPL
-    }
+    IN_PROC proc = context.cur_op ? context.cur_op->proc :
+        cpu_op_handler(context.cur_opcode);
 
     proc(&context);
 }
@@ -48,7 +56,6 @@ bool cpu_step() {
 
         fetch_instruction();
         emu_cycles(1);
-        fetch_data();
 
 #if CPU_DEBUG == 1
         char flags[16];
@@ -75,12 +82,15 @@ bool cpu_step() {
         }
 
         dbg_update();
-        dbg_print();
+
+        if (!emu_get_context()->headless) {
+            dbg_print();
+        }
 
         execute();
     } else {
-        //is halted...
-        emu_cycles(1);
+        //is halted, nothing changes until the next scheduled event...
+        emu_idle();
 
         if (context.int_flags) {
             context.halted = false;
@@ -109,4 +119,23 @@ void cpu_set_ie_register(u8 n) {
 
 void cpu_request_interrupt(interrupt_type t) {
     context.int_flags |= t;
-}
\ No newline at end of file
+}
+
+void cpu_serialize(state_buf *s) {
+    STATE_FIELD(s, context.regs);
+    STATE_FIELD(s, context.fetch_data);
+    STATE_FIELD(s, context.mem_dest);
+    STATE_FIELD(s, context.dest_is_mem);
+    STATE_FIELD(s, context.cur_opcode);
+    STATE_FIELD(s, context.halted);
+    STATE_FIELD(s, context.stepping);
+    STATE_FIELD(s, context.int_master_enabled);
+    STATE_FIELD(s, context.enabling_ime);
+    STATE_FIELD(s, context.ie_register);
+    STATE_FIELD(s, context.int_flags);
+
+    if (s->loading) {
+        context.cur_inst = instruction_by_opcode(context.cur_opcode);
+        context.cur_op = NULL;
+    }
+}
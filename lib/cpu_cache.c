@@ -0,0 +1,135 @@
+#include <cpu.h>
+#include <bus.h>
+#include <cart.h>
+#include <string.h>
+#include <gb.h>
+
+// block cache for rom resident code. straight-line runs of instructions are
+// decoded once into cached_op arrays, keyed by (rom bank, start pc). rom never
+// changes under a given bank so entries never need invalidating, code running
+// from ram takes the normal decode path instead.
+
+
+#define context (gb_cur->cpu_cache)
+
+void cpu_cache_init() {
+    memset(&context, 0, sizeof(context));
+}
+
+static u8 inst_length(instruction *inst) {
+    switch(inst->mode) {
+        case AM_R_D8:
+        case AM_R_A8:
+        case AM_A8_R:
+        case AM_HL_SPR:
+        case AM_D8:
+        case AM_MR_D8:
+            return 2;
+
+        case AM_R_D16:
+        case AM_D16:
+        case AM_A16_R:
+        case AM_D16_R:
+        case AM_R_A16:
+            return 3;
+
+        default:
+            return 1;
+    }
+}
+
+//instructions that can move pc somewhere other than the next op end a block.
+static bool ends_block(instruction *inst) {
+    switch(inst->type) {
+        case IN_JP:
+        case IN_JR:
+        case IN_CALL:
+        case IN_RET:
+        case IN_RETI:
+        case IN_RST:
+        case IN_JPHL:
+        case IN_HALT:
+        case IN_STOP:
+            return true;
+
+        default:
+            return false;
+    }
+}
+
+static void decode_block(cpu_block *b, u16 bank, u16 pc) {
+    //blocks never cross from bank 0 into the switchable bank.
+    u16 end = pc < 0x4000 ? 0x4000 : 0x8000;
+
+    b->valid = true;
+    b->bank = bank;
+    b->pc = pc;
+    b->count = 0;
+
+    while (b->count < BLOCK_MAX_OPS) {
+        cached_op *op = &b->ops[b->count];
+
+        op->opcode = bus_read(pc);
+        op->inst = instruction_by_opcode(op->opcode);
+        op->length = inst_length(op->inst);
+        op->proc = cpu_op_handler(op->opcode);
+
+        if (pc + op->length > end) {
+            break;
+        }
+
+        op->operand = 0;
+
+        if (op->length > 1) {
+            op->operand = bus_read(pc + 1);
+        }
+
+        if (op->length > 2) {
+            op->operand |= bus_read(pc + 2) << 8;
+        }
+
+        b->count++;
+        pc += op->length;
+
+        if (ends_block(op->inst)) {
+            break;
+        }
+    }
+}
+
+cached_op *cpu_cache_fetch(u16 pc) {
+    if (pc >= 0x8000) {
+        context.cur_block = NULL;
+        return NULL;
+    }
+
+    u16 bank = pc < 0x4000 ? 0 : cart_rom_bank();
+    cpu_block *b = context.cur_block;
+
+    if (b && pc == context.next_pc && bank == b->bank && context.cur_index < b->count) {
+        cached_op *op = &b->ops[context.cur_index++];
+        context.next_pc = pc + op->length;
+
+        return op;
+    }
+
+    //the bank is mixed into the low bits, the same pc in other banks would
+    //keep landing on the same slot otherwise.
+    b = &context.blocks[(pc ^ (bank * 0x9E37)) & (CACHE_SLOTS - 1)];
+
+    if (!b->valid || b->bank != bank || b->pc != pc) {
+        decode_block(b, bank, pc);
+    }
+
+    if (!b->count) {
+        //first op straddles a bank boundary.
+        context.cur_block = NULL;
+        return NULL;
+    }
+
+    context.cur_block = b;
+    context.cur_index = 1;
+    context.next_pc = pc + b->ops[0].length;
+
+    return &b->ops[0];
+}
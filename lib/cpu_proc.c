@@ -2,10 +2,14 @@
 #include <emu.h>
 #include <bus.h>
 #include <stack.h>
+#include <opcodes.h>
 
 //processes CPU instructions...
 
-void cpu_set_flags(cpu_context *context, int8_t z, int8_t n, int8_t h, int8_t c) {
+//every proc below is inlined into handlers generated from the opcode table,
+//with the instruction passed by value so its fields are compile time constants.
+
+ALWAYS_INLINE void set_flags(cpu_context *context, int8_t z, int8_t n, int8_t h, int8_t c) {
     if (z != -1) {
         BIT_SET(context->regs.f, 7, z);
     }
@@ -28,11 +32,11 @@ static void proc_none(cpu_context *context) {
     exit(-7);
 }
 
-static void proc_nop(cpu_context *context) {
+ALWAYS_INLINE void proc_nop(cpu_context *context, instruction inst) {
 
 }
 
-reg_type rt_lookup[] = {
+static const reg_type rt_lookup[] = {
     RT_B,
     RT_C,
     RT_D,
@@ -43,7 +47,7 @@ reg_type rt_lookup[] = {
     RT_A
 };
 
-reg_type decode_reg(u8 reg) {
+ALWAYS_INLINE reg_type decode_reg(u8 reg) {
     if (reg > 0b111) {
         return RT_NONE;
     }
@@ -51,12 +55,29 @@ reg_type decode_reg(u8 reg) {
     return rt_lookup[reg];
 }
 
-static void proc_cb(cpu_context *context) {
-    u8 op = context->fetch_data;
+ALWAYS_INLINE u8 reg8_read(cpu_context *context, reg_type rt) {
+    if (rt == RT_HL) {
+        return bus_read(cpu_regs_read(&context->regs, RT_HL));
+    }
+
+    return cpu_regs_read(&context->regs, rt);
+}
+
+ALWAYS_INLINE void reg8_write(cpu_context *context, reg_type rt, u8 val) {
+    if (rt == RT_HL) {
+        bus_write(cpu_regs_read(&context->regs, RT_HL), val);
+        return;
+    }
+
+    cpu_regs_write(&context->regs, rt, val);
+}
+
+//op is the CB prefixed opcode, constant in each generated CB handler.
+ALWAYS_INLINE void exec_cb(cpu_context *context, u8 op) {
     reg_type reg = decode_reg(op & 0b111);
     u8 bit = (op >> 3) & 0b111;
     u8 bit_op = (op >> 6) & 0b11;
-    u8 reg_val = cpu_read_reg8(reg);
+    u8 reg_val = reg8_read(context, reg);
 
     emu_cycles(1);
 
@@ -67,19 +88,19 @@ static void proc_cb(cpu_context *context) {
     switch(bit_op) {
         case 1:
             //BIT
-            cpu_set_flags(context, !(reg_val & (1 << bit)), 0, 1, -1);
+            set_flags(context, !(reg_val & (1 << bit)), 0, 1, -1);
             return;
 
         case 2:
             //RST
             reg_val &= ~(1 << bit);
-            cpu_set_reg8(reg, reg_val);
+            reg8_write(context, reg, reg_val);
             return;
 
         case 3:
             //SET
             reg_val |= (1 << bit);
-            cpu_set_reg8(reg, reg_val);
+            reg8_write(context, reg, reg_val);
             return;
     }
 
@@ -96,8 +117,8 @@ static void proc_cb(cpu_context *context) {
                 setC = true;
             }
 
-            cpu_set_reg8(reg, result);
-            cpu_set_flags(context, result == 0, false, false, setC);
+            reg8_write(context, reg, result);
+            set_flags(context, result == 0, false, false, setC);
         } return;
 
         case 1: {
@@ -106,8 +127,8 @@ static void proc_cb(cpu_context *context) {
             reg_val >>= 1;
             reg_val |= (old << 7);
 
-            cpu_set_reg8(reg, reg_val);
-            cpu_set_flags(context, !reg_val, false, false, old & 1);
+            reg8_write(context, reg, reg_val);
+            set_flags(context, !reg_val, false, false, old & 1);
         } return;
 
         case 2: {
@@ -116,8 +137,8 @@ static void proc_cb(cpu_context *context) {
             reg_val <<= 1;
             reg_val |= flagC;
 
-            cpu_set_reg8(reg, reg_val);
-            cpu_set_flags(context, !reg_val, false, false, !!(old & 0x80));
+            reg8_write(context, reg, reg_val);
+            set_flags(context, !reg_val, false, false, !!(old & 0x80));
         } return;
 
         case 3: {
@@ -127,8 +148,8 @@ static void proc_cb(cpu_context *context) {
 
             reg_val |= (flagC << 7);
 
-            cpu_set_reg8(reg, reg_val);
-            cpu_set_flags(context, !reg_val, false, false, old & 1);
+            reg8_write(context, reg, reg_val);
+            set_flags(context, !reg_val, false, false, old & 1);
         } return;
 
         case 4: {
@@ -136,29 +157,29 @@ static void proc_cb(cpu_context *context) {
             u8 old = reg_val;
             reg_val <<= 1;
 
-            cpu_set_reg8(reg, reg_val);
-            cpu_set_flags(context, !reg_val, false, false, !!(old & 0x80));
+            reg8_write(context, reg, reg_val);
+            set_flags(context, !reg_val, false, false, !!(old & 0x80));
         } return;
 
         case 5: {
             //SRA
             u8 u = (int8_t)reg_val >> 1;
-            cpu_set_reg8(reg, u);
-            cpu_set_flags(context, !u, 0, 0, reg_val & 1);
+            reg8_write(context, reg, u);
+            set_flags(context, !u, 0, 0, reg_val & 1);
         } return;
 
         case 6: {
             //SWAP
             reg_val = ((reg_val & 0xF0) >> 4) | ((reg_val & 0xF) << 4);
-            cpu_set_reg8(reg, reg_val);
-            cpu_set_flags(context, reg_val == 0, false, false, false);
+            reg8_write(context, reg, reg_val);
+            set_flags(context, reg_val == 0, false, false, false);
         } return;
 
         case 7: {
             //SRL
             u8 u = reg_val >> 1;
-            cpu_set_reg8(reg, u);
-            cpu_set_flags(context, !u, 0, 0, reg_val & 1);
+            reg8_write(context, reg, u);
+            set_flags(context, !u, 0, 0, reg_val & 1);
         } return;
     }
 
@@ -166,39 +187,67 @@ static void proc_cb(cpu_context *context) {
     NO_IMPL
 }
 
-static void proc_rlca(cpu_context *context) {
+//all 256 CB prefixed opcodes, 0x00 - 0xFF.
+#define CB_ROW(X, n) \
+    X(n##0) X(n##1) X(n##2) X(n##3) X(n##4) X(n##5) X(n##6) X(n##7) \
+    X(n##8) X(n##9) X(n##A) X(n##B) X(n##C) X(n##D) X(n##E) X(n##F)
+
+#define CB_TABLE(X) \
+    CB_ROW(X, 0x0) CB_ROW(X, 0x1) CB_ROW(X, 0x2) CB_ROW(X, 0x3) \
+    CB_ROW(X, 0x4) CB_ROW(X, 0x5) CB_ROW(X, 0x6) CB_ROW(X, 0x7) \
+    CB_ROW(X, 0x8) CB_ROW(X, 0x9) CB_ROW(X, 0xA) CB_ROW(X, 0xB) \
+    CB_ROW(X, 0xC) CB_ROW(X, 0xD) CB_ROW(X, 0xE) CB_ROW(X, 0xF)
+
+#define CB_HANDLER(op) \
+    static void cb_##op(cpu_context *context) { \
+        exec_cb(context, op); \
+    }
+
+#define CB_ENTRY(op) [op] = cb_##op,
+
+CB_TABLE(CB_HANDLER)
+
+static IN_PROC cb_handlers[0x100] = {
+    CB_TABLE(CB_ENTRY)
+};
+
+ALWAYS_INLINE void proc_cb(cpu_context *context, instruction inst) {
+    cb_handlers[context->fetch_data & 0xFF](context);
+}
+
+ALWAYS_INLINE void proc_rlca(cpu_context *context, instruction inst) {
     u8 u = context->regs.a;
     bool c = (u >> 7) & 1;
     u = (u << 1) | c;
     context->regs.a = u;
 
-    cpu_set_flags(context, 0, 0, 0, c);
+    set_flags(context, 0, 0, 0, c);
 }
 
-static void proc_rrca(cpu_context *context) {
+ALWAYS_INLINE void proc_rrca(cpu_context *context, instruction inst) {
     u8 b = context->regs.a & 1;
     context->regs.a >>= 1;
     context->regs.a |= (b << 7);
 
-    cpu_set_flags(context, 0, 0, 0, b);
+    set_flags(context, 0, 0, 0, b);
 }
 
 
-static void proc_rla(cpu_context *context) {
+ALWAYS_INLINE void proc_rla(cpu_context *context, instruction inst) {
     u8 u = context->regs.a;
     u8 cf = CPU_FLAG_C;
     u8 c = (u >> 7) & 1;
 
     context->regs.a = (u << 1) | cf;
-    cpu_set_flags(context, 0, 0, 0, c);
+    set_flags(context, 0, 0, 0, c);
 }
 
-static void proc_stop(cpu_context *context) {
+ALWAYS_INLINE void proc_stop(cpu_context *context, instruction inst) {
     fprintf(stderr, "STOPPING!\n");
     //NO_IMPL
 }
 
-static void proc_daa(cpu_context *context) {
+ALWAYS_INLINE void proc_daa(cpu_context *context, instruction inst) {
     u8 u = 0;
     int fc = 0;
 
@@ -213,75 +262,75 @@ static void proc_daa(cpu_context *context) {
 
     context->regs.a += CPU_FLAG_N ? -u : u;
 
-    cpu_set_flags(context, context->regs.a == 0, -1, 0, fc);
+    set_flags(context, context->regs.a == 0, -1, 0, fc);
 }
 
-static void proc_cpl(cpu_context *context) {
+ALWAYS_INLINE void proc_cpl(cpu_context *context, instruction inst) {
     context->regs.a = ~context->regs.a;
-    cpu_set_flags(context, -1, 1, 1, -1);
+    set_flags(context, -1, 1, 1, -1);
 }
 
-static void proc_scf(cpu_context *context) {
-    cpu_set_flags(context, -1, 0, 0, 1);
+ALWAYS_INLINE void proc_scf(cpu_context *context, instruction inst) {
+    set_flags(context, -1, 0, 0, 1);
 }
 
-static void proc_ccf(cpu_context *context) {
-    cpu_set_flags(context, -1, 0, 0, CPU_FLAG_C ^ 1);
+ALWAYS_INLINE void proc_ccf(cpu_context *context, instruction inst) {
+    set_flags(context, -1, 0, 0, CPU_FLAG_C ^ 1);
 }
 
-static void proc_halt(cpu_context *context) {
+ALWAYS_INLINE void proc_halt(cpu_context *context, instruction inst) {
     context->halted = true;
 }
 
-static void proc_rra(cpu_context *context) {
+ALWAYS_INLINE void proc_rra(cpu_context *context, instruction inst) {
     u8 carry = CPU_FLAG_C;
     u8 new_c = context->regs.a & 1;
 
     context->regs.a >>= 1;
     context->regs.a |= (carry << 7);
 
-    cpu_set_flags(context, 0, 0, 0, new_c);
+    set_flags(context, 0, 0, 0, new_c);
 }
 
-static void proc_and(cpu_context *context) {
+ALWAYS_INLINE void proc_and(cpu_context *context, instruction inst) {
     context->regs.a &= context->fetch_data;
-    cpu_set_flags(context, context->regs.a == 0, 0, 1, 0);
+    set_flags(context, context->regs.a == 0, 0, 1, 0);
 }
 
-static void proc_xor(cpu_context *context) {
+ALWAYS_INLINE void proc_xor(cpu_context *context, instruction inst) {
     context->regs.a ^= context->fetch_data & 0xFF;
-    cpu_set_flags(context, context->regs.a == 0, 0, 0, 0);
+    set_flags(context, context->regs.a == 0, 0, 0, 0);
 }
 
-static void proc_or(cpu_context *context) {
+ALWAYS_INLINE void proc_or(cpu_context *context, instruction inst) {
     context->regs.a |= context->fetch_data & 0xFF;
-    cpu_set_flags(context, context->regs.a == 0, 0, 0, 0);
+    set_flags(context, context->regs.a == 0, 0, 0, 0);
 }
 
-static void proc_cp(cpu_context *context) {
+ALWAYS_INLINE void proc_cp(cpu_context *context, instruction inst) {
     int n = (int)context->regs.a - (int)context->fetch_data;
 
-    cpu_set_flags(context, n == 0, 1, 
+    set_flags(context, n == 0, 1, 
         ((int)context->regs.a & 0x0F) - ((int)context->fetch_data & 0x0F) < 0, n < 0);
 }
 
-static void proc_di(cpu_context *context) {
+ALWAYS_INLINE void proc_di(cpu_context *context, instruction inst) {
     context->int_master_enabled = false;
 }
 
-static void proc_ei(cpu_context *context) {
+ALWAYS_INLINE void proc_ei(cpu_context *context, instruction inst) {
     context->enabling_ime = true;
 }
 
-static bool is_16_bit(reg_type rt) {
+ALWAYS_INLINE bool is_16_bit(reg_type rt) {
     return rt >= RT_AF;
 }
 
-static void proc_ld(cpu_context *context) {
+ALWAYS_INLINE void proc_ld(cpu_context *context, instruction inst) {
     if (context->dest_is_mem) {
         //LD (BC), A for instance...
 
-        if (is_16_bit(context->cur_inst->reg_2)) {
+        if (is_16_bit(inst.reg_2)) {
             //if 16 bit register...
             emu_cycles(1);
             bus_write16(context->mem_dest, context->fetch_data);
@@ -294,26 +343,26 @@ static void proc_ld(cpu_context *context) {
         return;
     }
 
-    if (context->cur_inst->mode == AM_HL_SPR) {
-        u8 hflag = (cpu_read_reg(context->cur_inst->reg_2) & 0xF) + 
+    if (inst.mode == AM_HL_SPR) {
+        u8 hflag = (cpu_regs_read(&context->regs, inst.reg_2) & 0xF) + 
             (context->fetch_data & 0xF) >= 0x10;
 
-        u8 cflag = (cpu_read_reg(context->cur_inst->reg_2) & 0xFF) + 
+        u8 cflag = (cpu_regs_read(&context->regs, inst.reg_2) & 0xFF) + 
             (context->fetch_data & 0xFF) >= 0x100;
 
-        cpu_set_flags(context, 0, 0, hflag, cflag);
-        cpu_set_reg(context->cur_inst->reg_1, 
-            cpu_read_reg(context->cur_inst->reg_2) + (int8_t)context->fetch_data);
+        set_flags(context, 0, 0, hflag, cflag);
+        cpu_regs_write(&context->regs, inst.reg_1, 
+            cpu_regs_read(&context->regs, inst.reg_2) + (int8_t)context->fetch_data);
 
         return;
     }
 
-    cpu_set_reg(context->cur_inst->reg_1, context->fetch_data);
+    cpu_regs_write(&context->regs, inst.reg_1, context->fetch_data);
 }
 
-static void proc_ldh(cpu_context *context) {
-    if (context->cur_inst->reg_1 == RT_A) {
-        cpu_set_reg(context->cur_inst->reg_1, bus_read(0xFF00 | context->fetch_data));
+ALWAYS_INLINE void proc_ldh(cpu_context *context, instruction inst) {
+    if (inst.reg_1 == RT_A) {
+        cpu_regs_write(&context->regs, inst.reg_1, bus_read(0xFF00 | context->fetch_data));
     } else {
         bus_write(context->mem_dest, context->regs.a);
     }
@@ -322,11 +371,11 @@ static void proc_ldh(cpu_context *context) {
 }
 
 
-static bool check_cond(cpu_context *context) {
+ALWAYS_INLINE bool check_cond(cpu_context *context, instruction inst) {
     bool z = CPU_FLAG_Z;
     bool c = CPU_FLAG_C;
 
-    switch(context->cur_inst->cond) {
+    switch(inst.cond) {
         case CT_NONE: return true;
         case CT_C: return c;
         case CT_NC: return !c;
@@ -337,8 +386,8 @@ static bool check_cond(cpu_context *context) {
     return false;
 }
 
-static void goto_addr(cpu_context *context, u16 addr, bool pushpc) {
-    if (check_cond(context)) {
+ALWAYS_INLINE void goto_addr(cpu_context *context, instruction inst, u16 addr, bool pushpc) {
+    if (check_cond(context, inst)) {
         if (pushpc) {
             emu_cycles(2);
             stack_push16(context->regs.pc);
@@ -349,30 +398,30 @@ static void goto_addr(cpu_context *context, u16 addr, bool pushpc) {
     }
 }
 
-static void proc_jp(cpu_context *context) {
-    goto_addr(context, context->fetch_data, false);
+ALWAYS_INLINE void proc_jp(cpu_context *context, instruction inst) {
+    goto_addr(context, inst, context->fetch_data, false);
 }
 
-static void proc_jr(cpu_context *context) {
+ALWAYS_INLINE void proc_jr(cpu_context *context, instruction inst) {
     int8_t rel = (int8_t)(context->fetch_data & 0xFF);
     u16 addr = context->regs.pc + rel;
-    goto_addr(context, addr, false);
+    goto_addr(context, inst, addr, false);
 }
 
-static void proc_call(cpu_context *context) {
-    goto_addr(context, context->fetch_data, true);
+ALWAYS_INLINE void proc_call(cpu_context *context, instruction inst) {
+    goto_addr(context, inst, context->fetch_data, true);
 }
 
-static void proc_rst(cpu_context *context) {
-    goto_addr(context, context->cur_inst->param, true);
+ALWAYS_INLINE void proc_rst(cpu_context *context, instruction inst) {
+    goto_addr(context, inst, inst.param, true);
 }
 
-static void proc_ret(cpu_context *context) {
-    if (context->cur_inst->cond != CT_NONE) {
+ALWAYS_INLINE void proc_ret(cpu_context *context, instruction inst) {
+    if (inst.cond != CT_NONE) {
         emu_cycles(1);
     }
 
-    if (check_cond(context)) {
+    if (check_cond(context, inst)) {
         u16 lo = stack_pop();
         emu_cycles(1);
         u16 hi = stack_pop();
@@ -385,12 +434,12 @@ static void proc_ret(cpu_context *context) {
     }
 }
 
-static void proc_reti(cpu_context *context) {
+ALWAYS_INLINE void proc_reti(cpu_context *context, instruction inst) {
     context->int_master_enabled = true;
-    proc_ret(context);
+    proc_ret(context, inst);
 }
 
-static void proc_pop(cpu_context *context) {
+ALWAYS_INLINE void proc_pop(cpu_context *context, instruction inst) {
     u16 lo = stack_pop();
     emu_cycles(1);
     u16 hi = stack_pop();
@@ -398,179 +447,375 @@ static void proc_pop(cpu_context *context) {
 
     u16 n = (hi << 8) | lo;
 
-    cpu_set_reg(context->cur_inst->reg_1, n);
+    cpu_regs_write(&context->regs, inst.reg_1, n);
 
-    if (context->cur_inst->reg_1 == RT_AF) {
-        cpu_set_reg(context->cur_inst->reg_1, n & 0xFFF0);
+    if (inst.reg_1 == RT_AF) {
+        cpu_regs_write(&context->regs, inst.reg_1, n & 0xFFF0);
     }
 }
 
-static void proc_push(cpu_context *context) {
-    u16 hi = (cpu_read_reg(context->cur_inst->reg_1) >> 8) & 0xFF;
+ALWAYS_INLINE void proc_push(cpu_context *context, instruction inst) {
+    u16 hi = (cpu_regs_read(&context->regs, inst.reg_1) >> 8) & 0xFF;
     emu_cycles(1);
     stack_push(hi);
 
-    u16 lo = cpu_read_reg(context->cur_inst->reg_1) & 0xFF;
+    u16 lo = cpu_regs_read(&context->regs, inst.reg_1) & 0xFF;
     emu_cycles(1);
     stack_push(lo);
     
     emu_cycles(1);
 }
 
-static void proc_inc(cpu_context *context) {
-    u16 val = cpu_read_reg(context->cur_inst->reg_1) + 1;
+ALWAYS_INLINE void proc_inc(cpu_context *context, instruction inst, u8 opcode) {
+    u16 val = cpu_regs_read(&context->regs, inst.reg_1) + 1;
 
-    if (is_16_bit(context->cur_inst->reg_1)) {
+    if (is_16_bit(inst.reg_1)) {
         emu_cycles(1);
     }
 
-    if (context->cur_inst->reg_1 == RT_HL && context->cur_inst->mode == AM_MR) {
-        val = bus_read(cpu_read_reg(RT_HL)) + 1;
+    if (inst.reg_1 == RT_HL && inst.mode == AM_MR) {
+        val = bus_read(cpu_regs_read(&context->regs, RT_HL)) + 1;
         val &= 0xFF;
-        bus_write(cpu_read_reg(RT_HL), val);
+        bus_write(cpu_regs_read(&context->regs, RT_HL), val);
     } else {
-        cpu_set_reg(context->cur_inst->reg_1, val);
-        val = cpu_read_reg(context->cur_inst->reg_1);
+        cpu_regs_write(&context->regs, inst.reg_1, val);
+        val = cpu_regs_read(&context->regs, inst.reg_1);
     }
 
-    if ((context->cur_opcode & 0x03) == 0x03) {
+    if ((opcode & 0x03) == 0x03) {
         return;
     }
 
-    cpu_set_flags(context, val == 0, 0, (val & 0x0F) == 0, -1);
+    set_flags(context, val == 0, 0, (val & 0x0F) == 0, -1);
 }
 
-static void proc_dec(cpu_context *context) {
-    u16 val = cpu_read_reg(context->cur_inst->reg_1) - 1;
+ALWAYS_INLINE void proc_dec(cpu_context *context, instruction inst, u8 opcode) {
+    u16 val = cpu_regs_read(&context->regs, inst.reg_1) - 1;
 
-    if (is_16_bit(context->cur_inst->reg_1)) {
+    if (is_16_bit(inst.reg_1)) {
         emu_cycles(1);
     }
 
-    if (context->cur_inst->reg_1 == RT_HL && context->cur_inst->mode == AM_MR) {
-        val = bus_read(cpu_read_reg(RT_HL)) - 1;
-        bus_write(cpu_read_reg(RT_HL), val);
+    if (inst.reg_1 == RT_HL && inst.mode == AM_MR) {
+        val = bus_read(cpu_regs_read(&context->regs, RT_HL)) - 1;
+        bus_write(cpu_regs_read(&context->regs, RT_HL), val);
     } else {
-        cpu_set_reg(context->cur_inst->reg_1, val);
-        val = cpu_read_reg(context->cur_inst->reg_1);
+        cpu_regs_write(&context->regs, inst.reg_1, val);
+        val = cpu_regs_read(&context->regs, inst.reg_1);
     }
 
-    if ((context->cur_opcode & 0x0B) == 0x0B) {
+    if ((opcode & 0x0B) == 0x0B) {
         return;
     }
 
-    cpu_set_flags(context, val == 0, 1, (val & 0x0F) == 0x0F, -1);
+    set_flags(context, val == 0, 1, (val & 0x0F) == 0x0F, -1);
 }
 
-static void proc_sub(cpu_context *context) {
-    u16 val = cpu_read_reg(context->cur_inst->reg_1) - context->fetch_data;
+ALWAYS_INLINE void proc_sub(cpu_context *context, instruction inst) {
+    u16 val = cpu_regs_read(&context->regs, inst.reg_1) - context->fetch_data;
 
     int z = val == 0;
-    int h = ((int)cpu_read_reg(context->cur_inst->reg_1) & 0xF) - ((int)context->fetch_data & 0xF) < 0;
-    int c = ((int)cpu_read_reg(context->cur_inst->reg_1)) - ((int)context->fetch_data) < 0;
+    int h = ((int)cpu_regs_read(&context->regs, inst.reg_1) & 0xF) - ((int)context->fetch_data & 0xF) < 0;
+    int c = ((int)cpu_regs_read(&context->regs, inst.reg_1)) - ((int)context->fetch_data) < 0;
 
-    cpu_set_reg(context->cur_inst->reg_1, val);
-    cpu_set_flags(context, z, 1, h, c);
+    cpu_regs_write(&context->regs, inst.reg_1, val);
+    set_flags(context, z, 1, h, c);
 }
 
-static void proc_sbc(cpu_context *context) {
+ALWAYS_INLINE void proc_sbc(cpu_context *context, instruction inst) {
     u8 val = context->fetch_data + CPU_FLAG_C;
 
-    int z = cpu_read_reg(context->cur_inst->reg_1) - val == 0;
+    int z = cpu_regs_read(&context->regs, inst.reg_1) - val == 0;
 
-    int h = ((int)cpu_read_reg(context->cur_inst->reg_1) & 0xF) 
+    int h = ((int)cpu_regs_read(&context->regs, inst.reg_1) & 0xF) 
         - ((int)context->fetch_data & 0xF) - ((int)CPU_FLAG_C) < 0;
-    int c = ((int)cpu_read_reg(context->cur_inst->reg_1)) 
+    int c = ((int)cpu_regs_read(&context->regs, inst.reg_1)) 
         - ((int)context->fetch_data) - ((int)CPU_FLAG_C) < 0;
 
-    cpu_set_reg(context->cur_inst->reg_1, cpu_read_reg(context->cur_inst->reg_1) - val);
-    cpu_set_flags(context, z, 1, h, c);
+    cpu_regs_write(&context->regs, inst.reg_1, cpu_regs_read(&context->regs, inst.reg_1) - val);
+    set_flags(context, z, 1, h, c);
 }
 
-static void proc_adc(cpu_context *context) {
+ALWAYS_INLINE void proc_adc(cpu_context *context, instruction inst) {
     u16 u = context->fetch_data;
     u16 a = context->regs.a;
     u16 c = CPU_FLAG_C;
 
     context->regs.a = (a + u + c) & 0xFF;
 
-    cpu_set_flags(context, context->regs.a == 0, 0, 
+    set_flags(context, context->regs.a == 0, 0, 
         (a & 0xF) + (u & 0xF) + c > 0xF,
         a + u + c > 0xFF);
 }
 
-static void proc_add(cpu_context *context) {
-    u32 val = cpu_read_reg(context->cur_inst->reg_1) + context->fetch_data;
+ALWAYS_INLINE void proc_add(cpu_context *context, instruction inst) {
+    u32 val = cpu_regs_read(&context->regs, inst.reg_1) + context->fetch_data;
 
-    bool is_16bit = is_16_bit(context->cur_inst->reg_1);
+    bool is_16bit = is_16_bit(inst.reg_1);
 
     if (is_16bit) {
         emu_cycles(1);
     }
 
-    if (context->cur_inst->reg_1 == RT_SP) {
-        val = cpu_read_reg(context->cur_inst->reg_1) + (int8_t)context->fetch_data;
+    if (inst.reg_1 == RT_SP) {
+        val = cpu_regs_read(&context->regs, inst.reg_1) + (int8_t)context->fetch_data;
     }
 
     int z = (val & 0xFF) == 0;
-    int h = (cpu_read_reg(context->cur_inst->reg_1) & 0xF) + (context->fetch_data & 0xF) >= 0x10;
-    int c = (int)(cpu_read_reg(context->cur_inst->reg_1) & 0xFF) + (int)(context->fetch_data & 0xFF) >= 0x100;
+    int h = (cpu_regs_read(&context->regs, inst.reg_1) & 0xF) + (context->fetch_data & 0xF) >= 0x10;
+    int c = (int)(cpu_regs_read(&context->regs, inst.reg_1) & 0xFF) + (int)(context->fetch_data & 0xFF) >= 0x100;
 
     if (is_16bit) {
         z = -1;
-        h = (cpu_read_reg(context->cur_inst->reg_1) & 0xFFF) + (context->fetch_data & 0xFFF) >= 0x1000;
-        u32 n = ((u32)cpu_read_reg(context->cur_inst->reg_1)) + ((u32)context->fetch_data);
+        h = (cpu_regs_read(&context->regs, inst.reg_1) & 0xFFF) + (context->fetch_data & 0xFFF) >= 0x1000;
+        u32 n = ((u32)cpu_regs_read(&context->regs, inst.reg_1)) + ((u32)context->fetch_data);
         c = n >= 0x10000;
     }
 
-    if (context->cur_inst->reg_1 == RT_SP) {
+    if (inst.reg_1 == RT_SP) {
         z = 0;
-        h = (cpu_read_reg(context->cur_inst->reg_1) & 0xF) + (context->fetch_data & 0xF) >= 0x10;
-        c = (int)(cpu_read_reg(context->cur_inst->reg_1) & 0xFF) + (int)(context->fetch_data & 0xFF) >= 0x100;
-    }
-
-    cpu_set_reg(context->cur_inst->reg_1, val & 0xFFFF);
-    cpu_set_flags(context, z, 0, h, c);
-}
-
-static IN_PROC processors[] = {
-    [IN_NONE] = proc_none,
-    [IN_NOP] = proc_nop,
-    [IN_LD] = proc_ld,
-    [IN_LDH] = proc_ldh,
-    [IN_JP] = proc_jp,
-    [IN_DI] = proc_di,
-    [IN_POP] = proc_pop,
-    [IN_PUSH] = proc_push,
-    [IN_JR] = proc_jr,
-    [IN_CALL] = proc_call,
-    [IN_RET] = proc_ret,
-    [IN_RST] = proc_rst,
-    [IN_DEC] = proc_dec,
-    [IN_INC] = proc_inc,
-    [IN_ADD] = proc_add,
-    [IN_ADC] = proc_adc,
-    [IN_SUB] = proc_sub,
-    [IN_SBC] = proc_sbc,
-    [IN_AND] = proc_and,
-    [IN_XOR] = proc_xor,
-    [IN_OR] = proc_or,
-    [IN_CP] = proc_cp,
-    [IN_CB] = proc_cb,
-    [IN_RRCA] = proc_rrca,
-    [IN_RLCA] = proc_rlca,
-    [IN_RRA] = proc_rra,
-    [IN_RLA] = proc_rla,
-    [IN_STOP] = proc_stop,
-    [IN_HALT] = proc_halt,
-    [IN_DAA] = proc_daa,
-    [IN_CPL] = proc_cpl,
-    [IN_SCF] = proc_scf,
-    [IN_CCF] = proc_ccf,
-    [IN_EI] = proc_ei,
-    [IN_RETI] = proc_reti
+        h = (cpu_regs_read(&context->regs, inst.reg_1) & 0xF) + (context->fetch_data & 0xF) >= 0x10;
+        c = (int)(cpu_regs_read(&context->regs, inst.reg_1) & 0xFF) + (int)(context->fetch_data & 0xFF) >= 0x100;
+    }
+
+    cpu_regs_write(&context->regs, inst.reg_1, val & 0xFFFF);
+    set_flags(context, z, 0, h, c);
+}
+
+//immediate byte n after the opcode, already decoded when running from the block cache.
+ALWAYS_INLINE u8 fetch_imm(cpu_context *context, int n) {
+    if (context->cur_op) {
+        return context->cur_op->operand >> (n * 8);
+    }
+
+    return bus_read(context->regs.pc + n);
+}
+
+//reads the operands for inst, the old fetch_data step.
+ALWAYS_INLINE void fetch_operands(cpu_context *context, instruction inst, u8 opcode) {
+    context->mem_dest = 0;
+    context->dest_is_mem = false;
+    
+    switch(inst.mode) {
+        case AM_IMP: return;
+
+        case AM_R:
+            context->fetch_data = cpu_regs_read(&context->regs, inst.reg_1);
+            return;
+
+        case AM_R_R:
+            context->fetch_data = cpu_regs_read(&context->regs, inst.reg_2);
+            return;
+
+        case AM_R_D8:
+            context->fetch_data = fetch_imm(context, 0);
+            emu_cycles(1);
+            context->regs.pc++;
+            return;
+
+        case AM_R_D16:
+        case AM_D16: {
+            u16 lo = fetch_imm(context, 0);
+            emu_cycles(1);
+
+            u16 hi = fetch_imm(context, 1);
+            emu_cycles(1);
+
+            context->fetch_data = lo | (hi << 8);
+
+            context->regs.pc += 2;
+
+            return;
+        }
+
+        case AM_MR_R:
+            context->fetch_data = cpu_regs_read(&context->regs, inst.reg_2);
+            context->mem_dest = cpu_regs_read(&context->regs, inst.reg_1);
+            context->dest_is_mem = true;
+
+            if (inst.reg_1 == RT_C) {
+                context->mem_dest |= 0xFF00;
+            }
+
+            return;
+
+        case AM_R_MR: {
+            u16 addr = cpu_regs_read(&context->regs, inst.reg_2);
+
+            if (inst.reg_2 == RT_C) {
+                addr |= 0xFF00;
+            }
+
+            context->fetch_data = bus_read(addr);
+            emu_cycles(1);
+
+        } return;
+
+        case AM_R_HLI:
+            context->fetch_data = bus_read(cpu_regs_read(&context->regs, inst.reg_2));
+            emu_cycles(1);
+            cpu_regs_write(&context->regs, RT_HL, cpu_regs_read(&context->regs, RT_HL) + 1);
+            return;
+
+        case AM_R_HLD:
+            context->fetch_data = bus_read(cpu_regs_read(&context->regs, inst.reg_2));
+            emu_cycles(1);
+            cpu_regs_write(&context->regs, RT_HL, cpu_regs_read(&context->regs, RT_HL) - 1);
+            return;
+
+        case AM_HLI_R:
+            context->fetch_data = cpu_regs_read(&context->regs, inst.reg_2);
+            context->mem_dest = cpu_regs_read(&context->regs, inst.reg_1);
+            context->dest_is_mem = true;
+            cpu_regs_write(&context->regs, RT_HL, cpu_regs_read(&context->regs, RT_HL) + 1);
+            return;
+
+        case AM_HLD_R:
+            context->fetch_data = cpu_regs_read(&context->regs, inst.reg_2);
+            context->mem_dest = cpu_regs_read(&context->regs, inst.reg_1);
+            context->dest_is_mem = true;
+            cpu_regs_write(&context->regs, RT_HL, cpu_regs_read(&context->regs, RT_HL) - 1);
+            return;
+
+        case AM_R_A8:
+            context->fetch_data = fetch_imm(context, 0);
+            emu_cycles(1);
+            context->regs.pc++;
+            return;
+
+        case AM_A8_R:
+            context->mem_dest = fetch_imm(context, 0) | 0xFF00;
+            context->dest_is_mem = true;
+            emu_cycles(1);
+            context->regs.pc++;
+            return;
+
+        case AM_HL_SPR:
+            context->fetch_data = fetch_imm(context, 0);
+            emu_cycles(1);
+            context->regs.pc++;
+            return;
+
+        case AM_D8:
+            context->fetch_data = fetch_imm(context, 0);
+            emu_cycles(1);
+            context->regs.pc++;
+            return;
+
+        case AM_A16_R:
+        case AM_D16_R: {
+            u16 lo = fetch_imm(context, 0);
+            emu_cycles(1);
+
+            u16 hi = fetch_imm(context, 1);
+            emu_cycles(1);
+
+            context->mem_dest = lo | (hi << 8);
+            context->dest_is_mem = true;
+
+            context->regs.pc += 2;
+            context->fetch_data = cpu_regs_read(&context->regs, inst.reg_2);
+
+        } return;
+
+        case AM_MR_D8:
+            context->fetch_data = fetch_imm(context, 0);
+            emu_cycles(1);
+            context->regs.pc++;
+            context->mem_dest = cpu_regs_read(&context->regs, inst.reg_1);
+            context->dest_is_mem = true;
+            return;
+
+        case AM_MR:
+            context->mem_dest = cpu_regs_read(&context->regs, inst.reg_1);
+            context->dest_is_mem = true;
+            context->fetch_data = bus_read(cpu_regs_read(&context->regs, inst.reg_1));
+            emu_cycles(1);
+            return;
+
+        case AM_R_A16: {
+            u16 lo = fetch_imm(context, 0);
+            emu_cycles(1);
+
+            u16 hi = fetch_imm(context, 1);
+            emu_cycles(1);
+
+            u16 addr = lo | (hi << 8);
+
+            context->regs.pc += 2;
+            context->fetch_data = bus_read(addr);
+            emu_cycles(1);
+
+            return;
+        }
+
+        default:
+            printf("Unknown Addressing Mode! %d (%02X)\n", inst.mode, opcode);
+            exit(-7);
+            return;
+    }
+}
+
+ALWAYS_INLINE void exec_op(cpu_context *context, u8 opcode, instruction inst) {
+    fetch_operands(context, inst, opcode);
+
+    switch(inst.type) {
+        case IN_NOP: proc_nop(context, inst); return;
+        case IN_LD: proc_ld(context, inst); return;
+        case IN_LDH: proc_ldh(context, inst); return;
+        case IN_JP: proc_jp(context, inst); return;
+        case IN_DI: proc_di(context, inst); return;
+        case IN_POP: proc_pop(context, inst); return;
+        case IN_PUSH: proc_push(context, inst); return;
+        case IN_JR: proc_jr(context, inst); return;
+        case IN_CALL: proc_call(context, inst); return;
+        case IN_RET: proc_ret(context, inst); return;
+        case IN_RST: proc_rst(context, inst); return;
+        case IN_DEC: proc_dec(context, inst, opcode); return;
+        case IN_INC: proc_inc(context, inst, opcode); return;
+        case IN_ADD: proc_add(context, inst); return;
+        case IN_ADC: proc_adc(context, inst); return;
+        case IN_SUB: proc_sub(context, inst); return;
+        case IN_SBC: proc_sbc(context, inst); return;
+        case IN_AND: proc_and(context, inst); return;
+        case IN_XOR: proc_xor(context, inst); return;
+        case IN_OR: proc_or(context, inst); return;
+        case IN_CP: proc_cp(context, inst); return;
+        case IN_CB: proc_cb(context, inst); return;
+        case IN_RRCA: proc_rrca(context, inst); return;
+        case IN_RLCA: proc_rlca(context, inst); return;
+        case IN_RRA: proc_rra(context, inst); return;
+        case IN_RLA: proc_rla(context, inst); return;
+        case IN_STOP: proc_stop(context, inst); return;
+        case IN_HALT: proc_halt(context, inst); return;
+        case IN_DAA: proc_daa(context, inst); return;
+        case IN_CPL: proc_cpl(context, inst); return;
+        case IN_SCF: proc_scf(context, inst); return;
+        case IN_CCF: proc_ccf(context, inst); return;
+        case IN_EI: proc_ei(context, inst); return;
+        case IN_RETI: proc_reti(context, inst); return;
+        default: proc_none(context); return;
+    }
+}
+
+//one handler per opcode in the table, named op_0x00 etc...
+#define OP_HANDLER(op, ...) \
+    static void op_##op(cpu_context *context) { \
+        exec_op(context, op, (instruction){__VA_ARGS__}); \
+    }
+
+#define OP_ENTRY(op, ...) [op] = op_##op,
+
+OPCODE_TABLE(OP_HANDLER)
+
+static IN_PROC op_handlers[0x100] = {
+    OPCODE_TABLE(OP_ENTRY)
 };
 
-IN_PROC inst_get_processor(in_type type) {
-    return processors[type];
-}
\ No newline at end of file
+static void op_invalid(cpu_context *context) {
+    proc_none(context);
+}
+
+IN_PROC cpu_op_handler(u8 opcode) {
+    return op_handlers[opcode] ? op_handlers[opcode] : op_invalid;
+}
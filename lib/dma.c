@@ -1,47 +1,55 @@
 #include <dma.h>
 #include <ppu.h>
 #include <bus.h>
+#include <emu.h>
+#include <scheduler.h>
+#include <gb.h>
 
 //For Windows
 #include <pthread.h>
 #include <unistd.h>
 
-typedef struct {
-    bool active;
-    u8 byte;
-    u8 value;
-    u8 start_delay;
-} dma_context;
 
-static dma_context context;
+
+#define context (gb_cur->dma)
 
 void dma_start(u8 start) {
-    context.active = true;
+    u64 now = emu_get_context()->ticks;
+
     context.byte = 0;
-    context.start_delay = 2;
     context.value = start;
-}
+    context.end = now + DMA_DURATION;
 
+    //two M-cycles of start delay, the first byte lands on the third.
+    sched_add(EV_DMA, now + 3 * 4);
+}
 
-void dma_tick() {
-    if (!context.active) {
-        return;
-    }
+void dma_event(u64 now) {
+    u16 source = context.value * 0x100;
+    u8 *page = bus_read_page(source);
 
-    if (context.start_delay) {
-        context.start_delay--;
+    if (page && !context.byte) {
+        //the source is one page of rom or ram. code runs from hram while a
+        //transfer is going, so the source holds still and goes over in one copy.
+        ppu_oam_load(page);
+        context.byte = DMA_LENGTH;
         return;
     }
 
-    ppu_oam_write(context.byte, bus_read((context.value * 0x100) + context.byte));
+    //io, oam or unmapped cartridge ram, read it the slow way.
+    ppu_oam_write(context.byte, bus_read(source + context.byte));
 
     context.byte++;
 
-    context.active = context.byte < 0xA0;
-
-
+    if (context.byte < DMA_LENGTH) {
+        sched_add(EV_DMA, now + 4);
+    }
 }
 
 bool dma_transferring() {
-    return context.active;
-}
\ No newline at end of file
+    return emu_get_context()->ticks < context.end;
+}
+
+void dma_serialize(state_buf *s) {
+    STATE_FIELD(s, context);
+}
@@ -1,4 +1,6 @@
 #include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include <emu.h>
 #include <cart.h>
 #include <cpu.h>
@@ -6,27 +8,180 @@
 #include <timer.h>
 #include <dma.h>
 #include <ppu.h>
-#include <audio.h>    
-#include <apu.h>  
+#include <ram.h>
+#include <dbg.h>
+#include <audio.h>
+#include <apu.h>
+#include <scheduler.h>
+#include <io.h>
+#include <lcd.h>
+#include <gamepad.h>
+#include <state.h>
+#include <replay.h>
+#include <gb.h>
 
 //TODO Add Windows Alternative...
 #include <pthread.h>
 #include <unistd.h>
 
-static emu_context context;
+#define context (gb_cur->emu)
 
 emu_context *emu_get_context() {
     return &context;
 }
 
-void *cpu_run(void *p) {
+// monotonic wall clock in microseconds, no SDL needed.
+static u64 emu_time_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (u64)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+// wakes the ui thread as soon as the cpu thread finishes a frame.
+static pthread_mutex_t frame_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t frame_cond = PTHREAD_COND_INITIALIZER;
+static u32 frames_signaled = 0;
+static u32 frames_presented = 0;
+
+static void emu_signal_frame() {
+    pthread_mutex_lock(&frame_lock);
+    frames_signaled++;
+    pthread_cond_broadcast(&frame_cond);
+    pthread_mutex_unlock(&frame_lock);
+}
+
+// waits for a frame newer than 'seen' or until timeout_ms passes,
+// returns the latest frame count.
+static u32 emu_wait_frame(u32 seen, u32 timeout_ms) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ts.tv_nsec += (long)timeout_ms * 1000000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    pthread_mutex_lock(&frame_lock);
+
+    while (frames_signaled == seen) {
+        if (pthread_cond_timedwait(&frame_cond, &frame_lock, &ts)) {
+            break;
+        }
+    }
+
+    seen = frames_signaled;
+    pthread_mutex_unlock(&frame_lock);
+
+    return seen;
+}
+
+// called on the ui thread once it has shown frame 'seen'.
+static void emu_frame_presented(u32 seen) {
+    pthread_mutex_lock(&frame_lock);
+    frames_presented = seen;
+    pthread_cond_broadcast(&frame_cond);
+    pthread_mutex_unlock(&frame_lock);
+}
+
+// vsync pacing, keeps the cpu at most one frame ahead of the display.
+static void emu_wait_presented() {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    //a hidden window may never present, don't stall forever on it.
+    ts.tv_nsec += 100 * 1000000;
+    ts.tv_sec += ts.tv_nsec / 1000000000;
+    ts.tv_nsec %= 1000000000;
+
+    pthread_mutex_lock(&frame_lock);
+
+    while (frames_signaled > frames_presented + 1) {
+        if (pthread_cond_timedwait(&frame_cond, &frame_lock, &ts)) {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&frame_lock);
+}
+
+static u64 pace_start = 0;
+static u64 pace_frames = 0;
+
+// timer pacing, deadlines are computed from the start so the 59.73 Hz
+// frame length never accumulates rounding error.
+static void emu_wait_timer() {
+    u64 now = emu_time_us();
+    u64 deadline = pace_start + ++pace_frames * LINES_PER_FRAME * TICKS_PER_LINE * 1000000 / GB_CPU_HZ;
+
+    //first frame, or too far behind to catch up: restart the clock.
+    if (!pace_start || now > deadline + 100000) {
+        pace_start = now;
+        pace_frames = 0;
+        return;
+    }
+
+    if (deadline > now) {
+        usleep(deadline - now);
+    }
+}
+
+static u32 start_timer = 0;
+static u32 frame_count = 0;
+
+// called on the cpu thread every time the ppu finishes a frame.
+static void emu_frame_done(u32 frame) {
+    if (context.headless) {
+        if (context.max_frames && frame >= context.max_frames) {
+            context.running = false;
+        }
+
+        return;
+    }
+
+    emu_signal_frame();
+
+    switch (context.pacing) {
+        case PACE_TIMER: emu_wait_timer(); break;
+        case PACE_AUDIO: apu_audio_wait(); break;
+        case PACE_VSYNC: emu_wait_presented(); break;
+    }
+
+    //calc FPS...
+    u32 end = get_ticks();
+
+    if (end - start_timer >= 1000) {
+        u32 fps = frame_count;
+        start_timer = end;
+        frame_count = 0;
+
+        printf("FPS: %d\n", fps);
+
+        if (cart_need_save()) {
+            cart_battery_save();
+        }
+    }
+
+    frame_count++;
+}
+
+void emu_reset() {
+    context.ticks = 0;
+
+    sched_init();
     timer_init();
     cpu_init();
+    ram_init();
     ppu_init();
+    apu_init();
+}
+
+void *cpu_run(void *p) {
+    emu_reset();
 
     context.running = true;
     context.paused = false;
-    context.ticks = 0;
+
+    u32 prev_frame = 0;
 
     while(context.running) {
         if (context.paused) {
@@ -38,26 +193,134 @@ void *cpu_run(void *p) {
             printf("CPU Stopped\n");
             return 0;
         }
+
+        if (prev_frame != ppu_get_context()->current_frame) {
+            //may seek, so the frame is read again after it.
+            replay_frame();
+            prev_frame = ppu_get_context()->current_frame;
+            emu_frame_done(prev_frame);
+        }
     }
 
     return 0;
 }
 
+void emu_step_frames(u32 frames) {
+    ppu_context *ppu = ppu_get_context();
+
+    //counts frame starts rather than aiming at a frame number, a replay
+    //seek can move current_frame anywhere.
+    while (frames) {
+        u32 frame = ppu->current_frame;
+        cpu_step();
+
+        if (ppu->current_frame != frame) {
+            replay_frame();
+            frames--;
+        }
+    }
+}
+
+static int emu_run_headless() {
+    u64 start = emu_time_us();
+
+    cpu_run(NULL);
+
+    u64 elapsed = emu_time_us() - start;
+    u32 frames = ppu_get_context()->current_frame;
+
+    dbg_print();
+
+    printf("Ran %u frames in %.3f s (%.1f FPS)\n", frames,
+        elapsed / 1000000.0, elapsed ? frames * 1000000.0 / elapsed : 0.0);
+
+    replay_stop();
+    cart_battery_close();
+
+    return 0;
+}
+
 int emu_run(int argc, char **argv) {
-    if (argc < 2) {
-        printf("Usage: emu <rom_file>\n");
+    char *rom = NULL;
+    u32 audio_rate = 0;
+    char *pace = NULL;
+    char *record = NULL;
+    char *play = NULL;
+    long seek = -1;
+
+    for (int i=1; i<argc; i++) {
+        if (!strcmp(argv[i], "--headless")) {
+            context.headless = true;
+        } else if (!strcmp(argv[i], "--frames") && i + 1 < argc) {
+            context.max_frames = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--audio-rate") && i + 1 < argc) {
+            audio_rate = strtoul(argv[++i], NULL, 10);
+        } else if (!strcmp(argv[i], "--renderer") && i + 1 < argc) {
+            ppu_get_context()->renderer =
+                !strcmp(argv[++i], "scanline") ? PPU_SCANLINE : PPU_FIFO;
+        } else if (!strcmp(argv[i], "--save-dir") && i + 1 < argc) {
+            cart_set_save_dir(argv[++i]);
+        } else if (!strcmp(argv[i], "--pace") && i + 1 < argc) {
+            pace = argv[++i];
+        } else if (!strcmp(argv[i], "--record") && i + 1 < argc) {
+            record = argv[++i];
+        } else if (!strcmp(argv[i], "--play") && i + 1 < argc) {
+            play = argv[++i];
+        } else if (!strcmp(argv[i], "--seek") && i + 1 < argc) {
+            seek = strtol(argv[++i], NULL, 10);
+        } else {
+            rom = argv[i];
+        }
+    }
+
+    if (!rom) {
+        printf("Usage: emu [--headless] [--frames N] [--audio-rate HZ] [--pace audio|vsync|timer] [--renderer fifo|scanline] [--save-dir DIR] [--record FILE | --play FILE [--seek FRAME]] <rom_file>\n");
         return -1;
     }
 
-    if (!cart_load(argv[1])) {
-        printf("Failed to load ROM file: %s\n", argv[1]);
+    if (record && play) {
+        fprintf(stderr, "--record and --play can't be used together\n");
+        return -1;
+    }
+
+    if (!cart_load(rom)) {
+        printf("Failed to load ROM file: %s\n", rom);
         return -2;
     }
 
     printf("Cart loaded..\n");
 
+    if (play && !replay_play(play)) {
+        return -3;
+    }
+
+    if (play && seek >= 0) {
+        replay_seek(seek);
+    }
+
+    if (record) {
+        replay_record(record);
+    }
+
+    if (context.headless) {
+        return emu_run_headless();
+    }
+
     ui_init();
-    apu_init();
+    bool audio = apu_audio_init(audio_rate);
+
+    //audio by default, the timer whenever the chosen source isn't there.
+    context.pacing = audio ? PACE_AUDIO : PACE_TIMER;
+
+    if (pace && !strcmp(pace, "timer")) {
+        context.pacing = PACE_TIMER;
+    } else if (pace && !strcmp(pace, "vsync")) {
+        context.pacing = ui_vsync() ? PACE_VSYNC : PACE_TIMER;
+    }
+
+    if (pace && context.pacing == PACE_TIMER && strcmp(pace, "timer")) {
+        printf("No %s to pace frames by, using the timer\n", pace);
+    }
 
 
     pthread_t t1;
@@ -66,32 +329,120 @@ int emu_run(int argc, char **argv) {
         return -1;
     }
 
-    u32 prev_frame = 0;
+    u32 seen = 0;
 
     while(!context.die) {
-        usleep(1000);
         ui_handle_events();
 
-        if (prev_frame != ppu_get_context()->current_frame) {
-            ui_update();
-        }
+        //still wake up now and then to handle input while paused.
+        seen = emu_wait_frame(seen, 10);
 
-        prev_frame = ppu_get_context()->current_frame;
+        if (ui_update()) {
+            emu_frame_presented(seen);
+        }
     }
 
+    //stop the cpu thread first so the last save sees all of ram.
+    context.running = false;
+    pthread_join(t1, NULL);
+
+    replay_stop();
+    cart_battery_close();
     apu_quit();
     return 0;
 }
 
 void emu_cycles(int cpu_cycles) {
+    //runs every M-cycle, so look the machine up once.
+    gb_t *gb = gb_cur;
+
     for (int i=0; i<cpu_cycles; i++) {
-        for (int n=0; n<4; n++) {
-            context.ticks++;
-            timer_tick();
-            ppu_tick();
-            apu_step(1); 
+        gb->emu.ticks += 4;
+
+        if (gb->emu.ticks >= sched_peek(&gb->sched)) {
+            sched_run(gb->emu.ticks);
         }
+    }
+}
+
+void emu_idle() {
+    u64 next = sched_next();
 
-        dma_tick();
+    if (next > context.ticks + 4 && next - context.ticks < 0x100000) {
+        //jump to the M-cycle the next event lands on.
+        context.ticks += ((next - context.ticks + 3) / 4 - 1) * 4;
     }
+
+    emu_cycles(1);
+}
+
+static void emu_serialize(state_buf *s) {
+    STATE_FIELD(s, context.ticks);
+
+    cpu_serialize(s);
+    ram_serialize(s);
+    cart_serialize(s);
+    io_serialize(s);
+    gamepad_serialize(s);
+    timer_serialize(s);
+    dma_serialize(s);
+    lcd_serialize(s);
+    ppu_serialize(s);
+    apu_serialize(s);
+
+    //last, the event times restored above must be in place first.
+    sched_serialize(s);
+}
+
+u32 emu_state_size() {
+    //only the cart's ram changes it, counted once per cart.
+    if (!context.state_size) {
+        state_buf s = {0};
+        emu_serialize(&s);
+
+        context.state_size = sizeof(state_header) + s.pos;
+    }
+
+    return context.state_size;
+}
+
+u32 emu_save_state(u8 *buf, u32 size) {
+    state_header header = {
+        .magic = STATE_MAGIC,
+        .version = STATE_VERSION,
+        .size = emu_state_size(),
+        .global_checksum = cart_global_checksum()
+    };
+
+    if (size < header.size) {
+        return 0;
+    }
+
+    memcpy(buf, &header, sizeof(header));
+
+    state_buf s = {buf + sizeof(header), 0, false};
+    emu_serialize(&s);
+
+    return header.size;
+}
+
+bool emu_load_state(const u8 *buf, u32 size) {
+    state_header header;
+
+    if (size < sizeof(header)) {
+        return false;
+    }
+
+    memcpy(&header, buf, sizeof(header));
+
+    if (header.magic != STATE_MAGIC || header.version != STATE_VERSION ||
+            header.size != size || size != emu_state_size() ||
+            header.global_checksum != cart_global_checksum()) {
+        return false;
+    }
+
+    state_buf s = {(u8 *)buf + sizeof(header), 0, true};
+    emu_serialize(&s);
+
+    return true;
 }
@@ -1,13 +1,10 @@
 #include <gamepad.h>
 #include <string.h>
+#include <gb.h>
 
-typedef struct {
-    bool button_sel;
-    bool dir_sel;
-    gamepad_state controller;
-} gamepad_context;
 
-static gamepad_context context = {0};
+
+#define context (gb_cur->gamepad)
 
 bool gamepad_button_sel() {
     return context.button_sel;
@@ -26,6 +23,26 @@ gamepad_state *gamepad_get_state() {
     return &context.controller;
 }
 
+gamepad_state *gamepad_get_keys() {
+    return &context.keys;
+}
+
+u8 gamepad_pack(const gamepad_state *state) {
+    return state->start << 0 | state->select << 1 | state->a << 2 | state->b << 3 |
+        state->up << 4 | state->down << 5 | state->left << 6 | state->right << 7;
+}
+
+void gamepad_unpack(u8 buttons, gamepad_state *state) {
+    state->start = BIT(buttons, 0);
+    state->select = BIT(buttons, 1);
+    state->a = BIT(buttons, 2);
+    state->b = BIT(buttons, 3);
+    state->up = BIT(buttons, 4);
+    state->down = BIT(buttons, 5);
+    state->left = BIT(buttons, 6);
+    state->right = BIT(buttons, 7);
+}
+
 u8 gamepad_get_output() {
     u8 output = 0xCF;
 
@@ -60,4 +77,11 @@ u8 gamepad_get_output() {
     }
 
     return output;
-}
\ No newline at end of file
+}
+
+void gamepad_serialize(state_buf *s) {
+    //the host's keys aren't part of the machine.
+    STATE_FIELD(s, context.button_sel);
+    STATE_FIELD(s, context.dir_sel);
+    STATE_FIELD(s, context.controller);
+}
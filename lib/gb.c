@@ -0,0 +1,27 @@
+#include <gb.h>
+
+static gb_t gb_default;
+
+_Thread_local gb_t *gb_cur = &gb_default;
+
+gb_t *gb_create() {
+    return calloc(1, sizeof(gb_t));
+}
+
+void gb_destroy(gb_t *gb) {
+    if (!gb || gb == &gb_default) {
+        return;
+    }
+
+    cart_free(&gb->cart);
+    replay_free(&gb->replay);
+
+    for (int i=0; i<3; i++) {
+        free(gb->ppu.frames[i]);
+    }
+    free(gb);
+}
+
+void gb_select(gb_t *gb) {
+    gb_cur = gb;
+}
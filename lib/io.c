@@ -5,8 +5,9 @@
 #include <cpu.h>
 #include <gamepad.h>
 #include <apu.h>   // <-- add this
+#include <gb.h>
 
-static char serial_data[2];
+#define context (gb_cur->io)
 
 u8 io_read(u16 address) {
     if (address == 0xFF00) {
@@ -14,11 +15,11 @@ u8 io_read(u16 address) {
     }
 
     if (address == 0xFF01) {
-        return serial_data[0];
+        return context.serial_data[0];
     }
 
     if (address == 0xFF02) {
-        return serial_data[1];
+        return context.serial_data[1];
     }
 
     if (BETWEEN(address, 0xFF04, 0xFF07)) {
@@ -49,12 +50,12 @@ void io_write(u16 address, u8 value) {
     }
     
     if (address == 0xFF01) {
-        serial_data[0] = value;
+        context.serial_data[0] = value;
         return;
     }
 
     if (address == 0xFF02) {
-        serial_data[1] = value;
+        context.serial_data[1] = value;
         return;
     }
 
@@ -81,3 +82,7 @@ void io_write(u16 address, u8 value) {
 
     printf("UNSUPPORTED bus_write(%04X, %02X)\n", address, value);
 }
+
+void io_serialize(state_buf *s) {
+    STATE_FIELD(s, context.serial_data);
+}
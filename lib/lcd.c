@@ -1,8 +1,9 @@
 #include <lcd.h>
 #include <ppu.h>
 #include <dma.h>
+#include <gb.h>
 
-static lcd_context context;
+#define context (gb_cur->lcd)
 
 static unsigned long colors_default[4] = {0xFFFFFFFF, 0xFFAAAAAA, 0xFF555555, 0xFF000000}; 
 
@@ -72,4 +73,8 @@ void lcd_write(u16 address, u8 value) {
     } else if (address == 0xFF49) {
         update_palette(value & 0b11111100, 2);
     }
-}
\ No newline at end of file
+}
+
+void lcd_serialize(state_buf *s) {
+    STATE_FIELD(s, context);
+}
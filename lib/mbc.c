@@ -0,0 +1,349 @@
+#include <mbc.h>
+#include <emu.h>
+#include <gb.h>
+#include <string.h>
+
+
+
+#define context (gb_cur->cart)
+
+// start of a switchable rom bank, wrapped to the size of the rom.
+static u8 *rom_bank(u16 bank) {
+    u32 banks = context.rom_size / 0x4000;
+
+    if (banks) {
+        bank %= banks;
+    }
+
+    return context.rom_data + 0x4000 * bank;
+}
+
+static void select_ram(u8 bank) {
+    context.ram_bank_number = bank;
+    context.ram_bank = context.ram_banks[bank];
+}
+
+// flags the page holding offset for the next battery save.
+static void ram_dirty(u16 offset) {
+    if (context.battery) {
+        context.ram_dirty[context.ram_bank_number] |= 1u << (offset >> 8);
+        context.need_save = true;
+    }
+}
+
+static u8 ram_read(u16 address) {
+    if (!context.ram_enabled) {
+        return 0xFF;
+    }
+
+    if (!context.ram_bank) {
+        return 0xFF;
+    }
+
+    return context.ram_bank[address - 0xA000];
+}
+
+static void ram_write(u16 address, u8 value) {
+    if (!context.ram_enabled) {
+        return;
+    }
+
+    if (!context.ram_bank) {
+        return;
+    }
+
+    context.ram_bank[address - 0xA000] = value;
+    ram_dirty(address - 0xA000);
+}
+
+static u8 mbc_read(u16 address) {
+    if (address < 0x4000) {
+        return context.rom_data[address];
+    }
+
+    if (address < 0x8000) {
+        return context.rom_bank_x[address - 0x4000];
+    }
+
+    return ram_read(address);
+}
+
+static void none_write(u16 address, u8 value) {
+    if ((address & 0xE000) == 0xA000) {
+        ram_write(address, value);
+    }
+}
+
+static void mbc1_write(u16 address, u8 value) {
+    if (address < 0x2000) {
+        context.ram_enabled = ((value & 0xF) == 0xA);
+    }
+
+    if ((address & 0xE000) == 0x2000) {
+        //rom bank number
+        if (value == 0) {
+            value = 1;
+        }
+
+        value &= 0b11111;
+
+        context.rom_bank_value = value;
+        context.rom_bank_x = rom_bank(context.rom_bank_value);
+    }
+
+    if ((address & 0xE000) == 0x4000) {
+        //ram bank number
+        context.ram_bank_value = value & 0b11;
+
+        if (context.ram_banking) {
+            select_ram(context.ram_bank_value);
+        }
+    }
+
+    if ((address & 0xE000) == 0x6000) {
+        //banking mode select
+        context.banking_mode = value & 1;
+
+        context.ram_banking = context.banking_mode;
+
+        if (context.ram_banking) {
+            select_ram(context.ram_bank_value);
+        }
+    }
+
+    if (address < 0x8000) {
+        cart_update_map();
+    }
+
+    if ((address & 0xE000) == 0xA000) {
+        ram_write(address, value);
+    }
+}
+
+static u8 mbc2_read(u16 address) {
+    if (address < 0x8000) {
+        return mbc_read(address);
+    }
+
+    if (!context.ram_enabled || !context.ram_bank) {
+        return 0xFF;
+    }
+
+    //512 half bytes, repeated over the whole area. the top bits float high.
+    return context.ram_bank[address & 0x1FF] | 0xF0;
+}
+
+static void mbc2_write(u16 address, u8 value) {
+    if (address < 0x4000) {
+        //address bit 8 picks the register.
+        if (address & 0x100) {
+            value &= 0xF;
+
+            if (value == 0) {
+                value = 1;
+            }
+
+            context.rom_bank_value = value;
+            context.rom_bank_x = rom_bank(context.rom_bank_value);
+        } else {
+            context.ram_enabled = ((value & 0xF) == 0xA);
+        }
+
+        cart_update_map();
+        return;
+    }
+
+    if ((address & 0xE000) == 0xA000 && context.ram_enabled && context.ram_bank) {
+        context.ram_bank[address & 0x1FF] = value & 0xF;
+        ram_dirty(address & 0x1FF);
+    }
+}
+
+// the clock runs on whole seconds of emulated time.
+void mbc_rtc_update() {
+    u64 now = emu_get_context()->ticks;
+
+    if (now < context.rtc_ticks) {
+        //the machine was reset under the clock.
+        context.rtc_ticks = now;
+    }
+
+    u64 secs = (now - context.rtc_ticks) / GB_CPU_HZ;
+
+    if (!secs) {
+        return;
+    }
+
+    context.rtc_ticks += secs * GB_CPU_HZ;
+    mbc_rtc_add(secs);
+}
+
+void mbc_rtc_add(u64 secs) {
+    if (context.rtc[4] & 0x40) {
+        //a halted clock lets the time pass without counting it.
+        return;
+    }
+
+    u8 *r = context.rtc;
+    u64 days = r[3] | ((r[4] & 1) << 8);
+    u64 total = r[0] + r[1] * 60 + r[2] * 3600 + days * 86400 + secs;
+
+    r[0] = total % 60;
+    r[1] = (total / 60) % 60;
+    r[2] = (total / 3600) % 24;
+    days = total / 86400;
+
+    if (days > 0x1FF) {
+        //day counter overflow, sticks until the game clears it.
+        r[4] |= 0x80;
+        days &= 0x1FF;
+    }
+
+    r[3] = days & 0xFF;
+    r[4] = (r[4] & 0xFE) | (days >> 8);
+}
+
+static u8 mbc3_read(u16 address) {
+    if (address >= 0xA000 && context.rtc_select) {
+        if (!context.ram_enabled) {
+            return 0xFF;
+        }
+
+        return context.rtc_latched[context.rtc_select - 0x08];
+    }
+
+    return mbc_read(address);
+}
+
+static void mbc3_write(u16 address, u8 value) {
+    static const u8 rtc_mask[5] = {0x3F, 0x3F, 0x1F, 0xFF, 0xC1};
+
+    if (address < 0x2000) {
+        //enables the clock registers too.
+        context.ram_enabled = ((value & 0xF) == 0xA);
+    } else if (address < 0x4000) {
+        //rom bank number
+        value &= 0x7F;
+
+        if (value == 0) {
+            value = 1;
+        }
+
+        context.rom_bank_value = value;
+        context.rom_bank_x = rom_bank(context.rom_bank_value);
+    } else if (address < 0x6000) {
+        //ram bank or clock register
+        if (value <= 0x03) {
+            context.rtc_select = 0;
+            context.ram_bank_value = value;
+            select_ram(value);
+        } else if (BETWEEN(value, 0x08, 0x0C)) {
+            context.rtc_select = value;
+        }
+    } else if (address < 0x8000) {
+        //latch the clock on a 0 then 1 write.
+        if (context.rtc_latch == 0 && value == 1) {
+            mbc_rtc_update();
+            memcpy(context.rtc_latched, context.rtc, sizeof(context.rtc));
+        }
+
+        context.rtc_latch = value;
+    } else if ((address & 0xE000) == 0xA000) {
+        if (!context.rtc_select) {
+            ram_write(address, value);
+            return;
+        }
+
+        if (!context.ram_enabled) {
+            return;
+        }
+
+        mbc_rtc_update();
+
+        if (context.rtc_select == 0x08) {
+            //writing the seconds restarts the current second.
+            context.rtc_ticks = emu_get_context()->ticks;
+        }
+
+        context.rtc[context.rtc_select - 0x08] = value & rtc_mask[context.rtc_select - 0x08];
+
+        if (context.battery) {
+            context.need_save = true;
+        }
+        return;
+    }
+
+    cart_update_map();
+}
+
+static void mbc5_write(u16 address, u8 value) {
+    if (address < 0x2000) {
+        context.ram_enabled = ((value & 0xF) == 0xA);
+    } else if (address < 0x3000) {
+        //low 8 bits of the rom bank, bank 0 can be selected here.
+        context.rom_bank_value = (context.rom_bank_value & 0x100) | value;
+        context.rom_bank_x = rom_bank(context.rom_bank_value);
+    } else if (address < 0x4000) {
+        //9th bit of the rom bank
+        context.rom_bank_value = (context.rom_bank_value & 0xFF) | ((value & 1) << 8);
+        context.rom_bank_x = rom_bank(context.rom_bank_value);
+    } else if (address < 0x6000) {
+        context.ram_bank_value = value & 0xF;
+        select_ram(context.ram_bank_value);
+    } else if (address < 0x8000) {
+        //nothing here
+        return;
+    } else {
+        ram_write(address, value);
+        return;
+    }
+
+    cart_update_map();
+}
+
+const cart_mapper mbc_none = {
+    .read = mbc_read,
+    .write = none_write,
+    .ram_open = true
+};
+
+const cart_mapper mbc1 = {
+    .read = mbc_read,
+    .write = mbc1_write
+};
+
+const cart_mapper mbc2 = {
+    .read = mbc2_read,
+    .write = mbc2_write,
+    .ram_nibbles = true
+};
+
+const cart_mapper mbc3 = {
+    .read = mbc3_read,
+    .write = mbc3_write
+};
+
+const cart_mapper mbc5 = {
+    .read = mbc_read,
+    .write = mbc5_write
+};
+
+const cart_mapper *mbc_for_type(u8 type) {
+    if (BETWEEN(type, 0x01, 0x03)) {
+        return &mbc1;
+    }
+
+    if (BETWEEN(type, 0x05, 0x06)) {
+        return &mbc2;
+    }
+
+    if (BETWEEN(type, 0x0F, 0x13)) {
+        return &mbc3;
+    }
+
+    if (BETWEEN(type, 0x19, 0x1E)) {
+        return &mbc5;
+    }
+
+    return &mbc_none;
+}
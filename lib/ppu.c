@@ -2,11 +2,16 @@
 #include <lcd.h>
 #include <string.h>
 #include <ppu_sm.h>
+#include <emu.h>
+#include <scheduler.h>
+#include <bus.h>
+#include <gb.h>
+#include <tile.h>
 
 void pipeline_fifo_reset();
 void pipeline_process();
 
-static ppu_context context;
+#define context (gb_cur->ppu)
 
 ppu_context *ppu_get_context() {
     return &context;
@@ -15,16 +20,27 @@ ppu_context *ppu_get_context() {
 void ppu_init() {
     context.current_frame = 0;
     context.line_ticks = 0;
-    context.video_buffer = malloc(YRES * XRES * sizeof(32));
+    for (int i=0; i<3; i++) {
+        if (!context.frames[i]) {
+            context.frames[i] = malloc(YRES * XRES * sizeof(u32));
+        }
+
+        memset(context.frames[i], 0, YRES * XRES * sizeof(u32));
+    }
+
+    context.back = 0;
+    context.front = 1;
+    atomic_store(&context.middle, 2);
+    context.video_buffer = context.frames[context.back];
 
     context.pfc.line_x = 0;
     context.pfc.pushed_x = 0;
     context.pfc.fetch_x = 0;
     context.pfc.pixel_fifo.size = 0;
-    context.pfc.pixel_fifo.head = context.pfc.pixel_fifo.tail = NULL;
+    context.pfc.pixel_fifo.head = context.pfc.pixel_fifo.tail = 0;
     context.pfc.cur_fetch_state = FS_TILE;
 
-    context.line_sprites = 0;
+    context.line_sprite_count = 0;
     context.fetched_entry_count = 0;
     context.window_line = 0;
 
@@ -32,7 +48,34 @@ void ppu_init() {
     LCDS_MODE_SET(MODE_OAM);
 
     memset(context.oam_ram, 0, sizeof(context.oam_ram));
-    memset(context.video_buffer, 0, YRES * XRES * sizeof(u32));
+    context.oam_dirty = true;
+    memset(context.tile_dirty, 0xFF, sizeof(context.tile_dirty));
+
+    //tile data writes go through ppu_vram_write to keep the tile cache
+    //coherent, the tile maps can be written directly.
+    bus_map(0x8000, 0x1800, context.vram, NULL);
+    bus_map(0x9800, 0x800, context.vram + 0x1800, context.vram + 0x1800);
+
+    context.last_tick = emu_get_context()->ticks;
+    sched_add(EV_PPU, context.last_tick + 1);
+}
+
+void ppu_frame_publish() {
+    u8 prev = atomic_exchange(&context.middle, context.back | FRAME_NEW);
+
+    context.back = prev & ~FRAME_NEW;
+    context.video_buffer = context.frames[context.back];
+}
+
+u32 *ppu_frame_acquire() {
+    if (!(atomic_load(&context.middle) & FRAME_NEW)) {
+        return NULL;
+    }
+
+    u8 prev = atomic_exchange(&context.middle, context.front);
+    context.front = prev & ~FRAME_NEW;
+
+    return context.frames[context.front];
 }
 
 void ppu_tick() {
@@ -54,6 +97,56 @@ void ppu_tick() {
     }
 }
 
+// dots until ppu_tick() next has something to do. outside of pixel
+// transfer the state machine only reacts to a few line_ticks values.
+static u32 ppu_idle_dots() {
+    switch(LCDS_MODE) {
+    case MODE_OAM:
+        //sprites load on tick 1, transfer starts on tick 80.
+        if (context.line_ticks == 0 || context.line_ticks >= 79) {
+            return 0;
+        }
+
+        return 79 - context.line_ticks;
+    case MODE_XFER:
+        if (context.line_renderer == PPU_FIFO) {
+            return 0;
+        }
+
+        //nothing happens until the line is drawn at the end of mode 3.
+        if (context.line_ticks >= scanline_xfer_end() - 1) {
+            return 0;
+        }
+
+        return scanline_xfer_end() - 1 - context.line_ticks;
+    default:
+        if (context.line_ticks >= TICKS_PER_LINE - 1) {
+            return 0;
+        }
+
+        return TICKS_PER_LINE - 1 - context.line_ticks;
+    }
+}
+
+void ppu_event(u64 now) {
+    while (context.last_tick < now) {
+        u64 idle = ppu_idle_dots();
+
+        if (idle > now - context.last_tick) {
+            idle = now - context.last_tick;
+        }
+
+        context.line_ticks += idle;
+        context.last_tick += idle;
+
+        if (context.last_tick < now) {
+            ppu_tick();
+            context.last_tick++;
+        }
+    }
+
+    sched_add(EV_PPU, now + ppu_idle_dots() + 1);
+}
 
 void ppu_oam_write(u16 address, u8 value) {
     if (address >= 0xFE00) {
@@ -62,6 +155,12 @@ void ppu_oam_write(u16 address, u8 value) {
 
     u8 *p = (u8 *)context.oam_ram;
     p[address] = value;
+    context.oam_dirty = true;
+}
+
+void ppu_oam_load(const u8 *data) {
+    memcpy(context.oam_ram, data, sizeof(context.oam_ram));
+    context.oam_dirty = true;
 }
 
 u8 ppu_oam_read(u16 address) {
@@ -74,9 +173,51 @@ u8 ppu_oam_read(u16 address) {
 }
 
 void ppu_vram_write(u16 address, u8 value) {
-    context.vram[address - 0x8000] = value;
+    u16 offset = address - 0x8000;
+    context.vram[offset] = value;
+
+    if (offset < TILE_COUNT * 16) {
+        u16 tile = offset / 16;
+        context.tile_dirty[tile / 64] |= 1ull << (tile % 64);
+    }
+}
+
+void ppu_tile_decode(ppu_context *ppu, u16 tile) {
+    u8 *data = &ppu->vram[tile * 16];
+
+    for (int row=0; row<8; row++) {
+        tile_decode_row(data[row * 2], data[row * 2 + 1], &ppu->tile_cache[tile][row * 8]);
+    }
+
+    ppu->tile_dirty[tile / 64] &= ~(1ull << (tile % 64));
 }
 
 u8 ppu_vram_read(u16 address) {
     return context.vram[address - 0x8000];
-}
\ No newline at end of file
+}
+
+void ppu_serialize(state_buf *s) {
+    STATE_FIELD(s, context.oam_ram);
+    STATE_FIELD(s, context.vram);
+
+    if (s->loading) {
+        memset(context.tile_dirty, 0xFF, sizeof(context.tile_dirty));
+    }
+    STATE_FIELD(s, context.pfc);
+    STATE_FIELD(s, context.fetched_entry_count);
+    STATE_FIELD(s, context.fetched_entries);
+    STATE_FIELD(s, context.window_line);
+    STATE_FIELD(s, context.current_frame);
+    STATE_FIELD(s, context.line_ticks);
+    STATE_FIELD(s, context.last_tick);
+
+    STATE_FIELD(s, context.line_sprite_count);
+    STATE_FIELD(s, context.line_sprites);
+
+    if (s->loading) {
+        context.oam_dirty = true;
+        context.line_renderer = context.renderer;
+    }
+
+    state_field(s, context.video_buffer, YRES * XRES * sizeof(u32));
+}
@@ -0,0 +1,139 @@
+#include <ppu.h>
+#include <lcd.h>
+#include <string.h>
+
+bool window_visible();
+
+//dot of the line the fifo leaves pixel transfer on, for each fine scroll.
+//the scanline renderer holds mode 3 just as long so stat timing matches.
+static const u16 xfer_end[8] = {297, 300, 301, 302, 303, 304, 305, 306};
+
+u32 scanline_xfer_end() {
+    return xfer_end[lcd_get_context()->scroll_x & 7];
+}
+
+//draws the current line in one go with the same rules the fifo applies
+//dot by dot, reading the registers once.
+void scanline_render() {
+    ppu_context *ppu = ppu_get_context();
+    lcd_context *lcd = lcd_get_context();
+
+    u8 lcdc = lcd->lcdc;
+    u8 ly = lcd->ly;
+    u8 fine_x = lcd->scroll_x & 7;
+    u8 map_y = ly + lcd->scroll_y;
+    u8 tile_y = (map_y % 8) * 2;
+
+    bool bgw_enable = BIT(lcdc, 0);
+    bool obj_enable = BIT(lcdc, 1) && ppu->line_sprite_count;
+    u8 sprite_height = BIT(lcdc, 2) ? 16 : 8;
+    u16 bg_map = BIT(lcdc, 3) ? 0x1C00 : 0x1800;
+    u16 tile_data = BIT(lcdc, 4) ? 0 : 0x800;
+    u16 win_map = BIT(lcdc, 6) ? 0x1C00 : 0x1800;
+
+    bool win = window_visible() && ly >= lcd->win_y && ly < lcd->win_y + XRES;
+    u8 w_tile_y = ppu->window_line / 8;
+
+    u32 *line = ppu->video_buffer + ly * XRES;
+
+    //bg off still decodes the indices, sprites use them for priority.
+    u32 bg_off[4] = {lcd->bg_colors[0], lcd->bg_colors[0], lcd->bg_colors[0], lcd->bg_colors[0]};
+
+    //the fifo fetches a tile or two past the right edge. the last tile
+    //number is left in bgw_fetch_data[0] and reused while bg is off.
+    int tiles = fine_x >= 3 ? 23 : 22;
+    u8 tile = ppu->pfc.bgw_fetch_data[0];
+
+    for (int t=0; t<tiles; t++) {
+        int fetch_x = t * 8;
+
+        if (bgw_enable) {
+            u8 map_x = fetch_x + lcd->scroll_x;
+            tile = ppu->vram[bg_map + (map_x / 8) + (map_y / 8) * 32];
+
+            if (win && fetch_x + 7 >= lcd->win_x && fetch_x + 7 < lcd->win_x + YRES + 14) {
+                tile = ppu->vram[win_map + ((fetch_x + 7 - lcd->win_x) / 8) + (w_tile_y * 32)];
+            }
+
+            if (tile_data) {
+                tile += 128;
+            }
+        }
+
+        if (fetch_x >= fine_x + XRES) {
+            continue;
+        }
+
+        const u8 *bg_index = ppu_tile_row(ppu, tile_data / 16 + tile, tile_y / 2);
+        const u32 *pal = bgw_enable ? lcd->bg_colors : bg_off;
+        u32 colors[8];
+
+        for (int i=0; i<8; i++) {
+            colors[i] = pal[bg_index[i]];
+        }
+
+        //the fifo looks at no more than 3 sprites per tile.
+        oam_entry sprites[3];
+        const u8 *sprite_index[3];
+        int sprite_count = 0;
+
+        if (obj_enable) {
+            for (int i=0; i<ppu->line_sprite_count && sprite_count < 3; i++) {
+                int sp_x = (ppu->line_sprites[i].x - 8) + fine_x;
+
+                if (sp_x >= fetch_x + 8) {
+                    break;
+                }
+
+                if ((sp_x >= fetch_x && sp_x < fetch_x + 8) ||
+                    ((sp_x + 8) >= fetch_x && (sp_x + 8) < fetch_x + 8)) {
+                    oam_entry e = ppu->line_sprites[i];
+                    u8 ty = ((ly + 16) - e.y) * 2;
+
+                    if (e.f_y_flip) {
+                        ty = ((sprite_height * 2) - 2) - ty;
+                    }
+
+                    u8 tile_index = e.tile;
+
+                    if (sprite_height == 16) {
+                        tile_index &= ~(1);
+                    }
+
+                    sprite_index[sprite_count] = ppu_tile_row(ppu, tile_index + ty / 16, (ty / 2) % 8);
+                    sprites[sprite_count++] = e;
+                }
+            }
+        }
+
+        for (int i=0; i<8 && sprite_count; i++) {
+            for (int s=0; s<sprite_count; s++) {
+                int offset = fetch_x + i - ((sprites[s].x - 8) + fine_x);
+
+                if (offset < 0 || offset > 7) {
+                    continue;
+                }
+
+                u8 index = sprite_index[s][sprites[s].f_x_flip ? 7 - offset : offset];
+
+                if (!index) {
+                    //transparent
+                    continue;
+                }
+
+                if (!sprites[s].f_bgp || bg_index[i] == 0) {
+                    colors[i] = sprites[s].f_pn ? lcd->sp2_colors[index] : lcd->sp1_colors[index];
+                    break;
+                }
+            }
+        }
+
+        //only the part of the tile that lands on screen.
+        int first = fetch_x < fine_x ? fine_x - fetch_x : 0;
+        int last = fetch_x + 8 - fine_x > XRES ? XRES + fine_x - fetch_x : 8;
+
+        memcpy(line + fetch_x + first - fine_x, colors + first, (last - first) * sizeof(u32));
+    }
+
+    ppu->pfc.bgw_fetch_data[0] = tile;
+}
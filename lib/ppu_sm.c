@@ -3,10 +3,6 @@
 #include <cpu.h>
 #include <interrupts.h>
 #include <string.h>
-#include <cart.h>
-
-// for windows library
-#include <SDL.h>
 
 void pipeline_fifo_reset();
 void pipeline_process();
@@ -31,64 +27,60 @@ void increment_ly() {
     }
 }
 
-void load_line_sprites() {
-    int cur_y = lcd_get_context()->ly;
-
-    u8 sprite_height = LCDC_OBJ_HEIGHT;
-    memset(ppu_get_context()->line_entry_array, 0, 
-        sizeof(ppu_get_context()->line_entry_array));
+//buckets every sprite into the lines it covers, one pass over oam.
+static void build_sprite_index(ppu_context *ppu, u8 sprite_height) {
+    memset(ppu->sprite_index_count, 0, sizeof(ppu->sprite_index_count));
 
     for (int i=0; i<40; i++) {
-        oam_entry e = ppu_get_context()->oam_ram[i];
+        oam_entry e = ppu->oam_ram[i];
 
         if (!e.x) {
             //x = 0 means not visible...
             continue;
         }
 
-        if (ppu_get_context()->line_sprite_count >= 10) {
-            //max 10 sprites per line...
-            break;
-        }
+        int first = e.y - 16;
+        int last = first + sprite_height - 1;
 
-        if (e.y <= cur_y + 16 && e.y + sprite_height > cur_y + 16) {
-            //this sprite is on the current line.
+        if (first < 0) first = 0;
+        if (last >= YRES) last = YRES - 1;
 
-            oam_line_entry *entry = &ppu_get_context()->line_entry_array[
-                ppu_get_context()->line_sprite_count++
-            ];
-
-            entry->entry = e;
-            entry->next = NULL;
-
-            if (!ppu_get_context()->line_sprites ||
-                    ppu_get_context()->line_sprites->entry.x > e.x) {
-                entry->next = ppu_get_context()->line_sprites;
-                ppu_get_context()->line_sprites = entry;
-                continue;
+        for (int y=first; y<=last; y++) {
+            //max 10 sprites per line, the first ones in oam win.
+            if (ppu->sprite_index_count[y] < 10) {
+                ppu->sprite_index[y][ppu->sprite_index_count[y]++] = i;
             }
+        }
+    }
+
+    ppu->sprite_index_height = sprite_height;
+    ppu->oam_dirty = false;
+}
 
-            //do some sorting...
+void load_line_sprites() {
+    ppu_context *ppu = ppu_get_context();
+    int cur_y = lcd_get_context()->ly;
+    u8 sprite_height = LCDC_OBJ_HEIGHT;
 
-            oam_line_entry *le = ppu_get_context()->line_sprites;
-            oam_line_entry *prev = le;
+    if (ppu->oam_dirty || ppu->sprite_index_height != sprite_height) {
+        build_sprite_index(ppu, sprite_height);
+    }
 
-            while(le) {
-                if (le->entry.x > e.x) {
-                    prev->next = entry;
-                    entry->next = le;
-                    break;
-                }
+    if (cur_y >= YRES) {
+        return;
+    }
 
-                if (!le->next) {
-                    le->next = entry;
-                    break;
-                }
+    //insertion sort by x, sprites with the same x keep their oam order.
+    for (int i=0; i<ppu->sprite_index_count[cur_y]; i++) {
+        oam_entry e = ppu->oam_ram[ppu->sprite_index[cur_y][i]];
+        int pos = ppu->line_sprite_count++;
 
-                prev = le;
-                le = le->next;
-            }
+        while (pos > 0 && ppu->line_sprites[pos - 1].x > e.x) {
+            ppu->line_sprites[pos] = ppu->line_sprites[pos - 1];
+            pos--;
         }
+
+        ppu->line_sprites[pos] = e;
     }
 }
 
@@ -101,28 +93,44 @@ void ppu_mode_oam() {
         ppu_get_context()->pfc.fetch_x = 0;
         ppu_get_context()->pfc.pushed_x = 0;
         ppu_get_context()->pfc.fifo_x = 0;
+
+        //a renderer switch only takes effect between lines, and the fifo
+        //starts out empty whichever one draws this line.
+        ppu_get_context()->line_renderer = ppu_get_context()->renderer;
+        pipeline_fifo_reset();
     }
 
     if (ppu_get_context()->line_ticks == 1) {
         //read oam on the first tick only...
-        ppu_get_context()->line_sprites = 0;
         ppu_get_context()->line_sprite_count = 0;
 
         load_line_sprites();
     }
 }
 
+static void enter_hblank() {
+    LCDS_MODE_SET(MODE_HBLANK);
+
+    if (LCDS_STAT_INT(SS_HBLANK)) {
+        cpu_request_interrupt(IT_LCD_STAT);
+    }
+}
+
 void ppu_mode_xfer() {
+    if (ppu_get_context()->line_renderer == PPU_SCANLINE) {
+        if (ppu_get_context()->line_ticks >= scanline_xfer_end()) {
+            scanline_render();
+            enter_hblank();
+        }
+
+        return;
+    }
+
     pipeline_process();
 
     if (ppu_get_context()->pfc.pushed_x >= XRES) {
         pipeline_fifo_reset();
-
-        LCDS_MODE_SET(MODE_HBLANK);
-
-        if (LCDS_STAT_INT(SS_HBLANK)) {
-            cpu_request_interrupt(IT_LCD_STAT);
-        }
+        enter_hblank();
     }
 }
 
@@ -140,11 +148,6 @@ void ppu_mode_vblank() {
     }
 }
 
-static u32 target_frame_time = 1000 / 60;
-static long prev_frame_time = 0;
-static long start_timer = 0;
-static long frame_count = 0;
-
 void ppu_mode_hblank() {
     if (ppu_get_context()->line_ticks >= TICKS_PER_LINE) {
         increment_ly();
@@ -158,31 +161,12 @@ void ppu_mode_hblank() {
                 cpu_request_interrupt(IT_LCD_STAT);
             }
 
-            ppu_get_context()->current_frame++;
-
-            //calc FPS...
-            u32 end = SDL_GetTicks();
-            u32 frame_time = end - prev_frame_time;
-
-            if (frame_time < target_frame_time) {
-                SDL_Delay((target_frame_time - frame_time));
-            }
-
-            if (end - start_timer >= 1000) {
-                u32 fps = frame_count;
-                start_timer = end;
-                frame_count = 0;
-
-                printf("FPS: %d\n", fps);
-
-                if (cart_need_save()) {
-                    cart_battery_save();
-                }
+            //with the lcd off nothing gets drawn, keep showing the last frame.
+            if (LCDC_LCD_ENABLE) {
+                ppu_frame_publish();
             }
 
-            frame_count++;
-            prev_frame_time = SDL_GetTicks();
-
+            ppu_get_context()->current_frame++;
         } else {
             LCDS_MODE_SET(MODE_OAM);
         }
@@ -1,11 +1,17 @@
 #include <ram.h>
+#include <bus.h>
+#include <gb.h>
+#include <string.h>
 
-typedef struct {
-    u8 wram[0x2000];
-    u8 hram[0x80];
-} ram_context;
 
-static ram_context context;
+
+#define context (gb_cur->ram)
+
+void ram_init() {
+    memset(&context, 0, sizeof(context));
+
+    bus_map(0xC000, sizeof(context.wram), context.wram, context.wram);
+}
 
 u8 wram_read(u16 address) {
     address -= 0xC000;
@@ -34,4 +40,8 @@ void hram_write(u16 address, u8 value) {
     address -= 0xFF80;
 
     context.hram[address] = value;
-}
\ No newline at end of file
+}
+
+void ram_serialize(state_buf *s) {
+    STATE_FIELD(s, context);
+}
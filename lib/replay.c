@@ -0,0 +1,301 @@
+#include <replay.h>
+#include <gamepad.h>
+#include <cart.h>
+#include <ppu.h>
+#include <emu.h>
+#include <gb.h>
+#include <stdio.h>
+#include <string.h>
+
+
+
+#define context (gb_cur->replay)
+
+static void runs_push(u8 byte) {
+    if (context.runs_len == context.runs_cap) {
+        context.runs_cap = context.runs_cap ? context.runs_cap * 2 : 256;
+        context.runs = realloc(context.runs, context.runs_cap);
+    }
+
+    context.runs[context.runs_len++] = byte;
+}
+
+static void flush_run() {
+    if (!context.run_length) {
+        return;
+    }
+
+    runs_push(context.run_buttons);
+
+    u32 n = context.run_length;
+
+    while (n >= 0x80) {
+        runs_push((n & 0x7F) | 0x80);
+        n >>= 7;
+    }
+
+    runs_push(n);
+    context.run_length = 0;
+}
+
+static void record_buttons(u8 buttons) {
+    if (context.run_length && buttons == context.run_buttons) {
+        context.run_length++;
+        return;
+    }
+
+    flush_run();
+    context.run_buttons = buttons;
+    context.run_length = 1;
+}
+
+// buttons for a frame of the replay, runs are decoded in order and a step
+// back starts over from the first one.
+static u8 play_buttons(u32 frame) {
+    if (frame < context.play_start) {
+        context.play_pos = 0;
+        context.play_start = 0;
+        context.play_length = 0;
+    }
+
+    while (frame >= context.play_start + context.play_length &&
+            context.play_pos < context.runs_len) {
+        context.play_start += context.play_length;
+        context.play_buttons = context.runs[context.play_pos++];
+        context.play_length = 0;
+
+        for (int shift = 0; context.play_pos < context.runs_len; shift += 7) {
+            u8 b = context.runs[context.play_pos++];
+            context.play_length |= (u32)(b & 0x7F) << shift;
+
+            if (!(b & 0x80)) {
+                break;
+            }
+        }
+    }
+
+    return context.play_buttons;
+}
+
+static void clear_keyframes() {
+    for (u32 i=0; i<context.keyframe_count; i++) {
+        free(context.keyframes[i]);
+    }
+
+    context.keyframe_count = 0;
+}
+
+static void push_keyframe(u8 *state) {
+    if (context.keyframe_count == context.keyframe_cap) {
+        context.keyframe_cap = context.keyframe_cap ? context.keyframe_cap * 2 : 16;
+        context.keyframes = realloc(context.keyframes, context.keyframe_cap * sizeof(u8 *));
+    }
+
+    context.keyframes[context.keyframe_count++] = state;
+}
+
+static void add_keyframe() {
+    u8 *state = malloc(context.state_size);
+    emu_save_state(state, context.state_size);
+    push_keyframe(state);
+}
+
+static void start_recording() {
+    clear_keyframes();
+
+    context.runs_len = 0;
+    context.run_length = 0;
+    context.frames = 0;
+    context.start_frame = ppu_get_context()->current_frame;
+    context.state_size = emu_state_size();
+    context.mode = REPLAY_RECORD;
+    context.loaded = false;
+
+    printf("Recording input from frame %u\n", context.start_frame);
+}
+
+// latches this frame's buttons, taking a keyframe first when one is due so
+// loading it and latching again lands in the same place.
+static void latch_frame() {
+    gamepad_state *pad = gamepad_get_state();
+    u32 frame = ppu_get_context()->current_frame - context.start_frame;
+
+    if (context.mode == REPLAY_OFF) {
+        *pad = *gamepad_get_keys();
+        return;
+    }
+
+    if (context.mode == REPLAY_PLAY && frame >= context.frames) {
+        printf("Replay finished at frame %u\n", ppu_get_context()->current_frame);
+        context.mode = REPLAY_OFF;
+        *pad = *gamepad_get_keys();
+        return;
+    }
+
+    if (frame % REPLAY_KEYFRAME_INTERVAL == 0 &&
+            frame / REPLAY_KEYFRAME_INTERVAL == context.keyframe_count) {
+        add_keyframe();
+    }
+
+    if (context.mode == REPLAY_RECORD) {
+        *pad = *gamepad_get_keys();
+        record_buttons(gamepad_pack(pad));
+        context.frames++;
+    } else {
+        gamepad_unpack(play_buttons(frame), pad);
+    }
+}
+
+// restores the closest keyframe at or before frame and plays on from it.
+static void seek_to(u32 frame) {
+    if (frame > context.frames) {
+        frame = context.frames;
+    }
+
+    u32 key = frame / REPLAY_KEYFRAME_INTERVAL;
+
+    if (key >= context.keyframe_count) {
+        key = context.keyframe_count - 1;
+    }
+
+    emu_load_state(context.keyframes[key], context.state_size);
+    latch_frame();
+
+    //replay_frame runs for each of these and feeds them the recorded input.
+    emu_step_frames(frame - key * REPLAY_KEYFRAME_INTERVAL);
+}
+
+void replay_frame() {
+    if (context.record_pending) {
+        context.record_pending = false;
+        start_recording();
+    }
+
+    if (context.seek_pending) {
+        context.seek_pending = false;
+
+        //only a loaded replay has keyframes for every frame it covers.
+        if (context.loaded) {
+            context.mode = REPLAY_PLAY;
+            seek_to(context.seek_frame);
+            return;
+        }
+    }
+
+    latch_frame();
+}
+
+void replay_record(const char *path) {
+    snprintf(context.path, sizeof(context.path), "%s", path);
+    context.record_pending = true;
+}
+
+bool replay_play(const char *path) {
+    FILE *fp = fopen(path, "rb");
+
+    if (!fp) {
+        fprintf(stderr, "FAILED TO OPEN: %s\n", path);
+        return false;
+    }
+
+    replay_header header;
+    u32 state_size = emu_state_size();
+    bool ok = fread(&header, sizeof(header), 1, fp) == 1 &&
+        header.magic == REPLAY_MAGIC && header.version == REPLAY_VERSION &&
+        header.global_checksum == cart_global_checksum() &&
+        header.state_size == state_size;
+
+    u8 *state = ok ? malloc(state_size) : NULL;
+    ok = ok && fread(state, state_size, 1, fp) == 1;
+
+    if (!ok) {
+        fprintf(stderr, "Not a replay of this game: %s\n", path);
+        free(state);
+        fclose(fp);
+        return false;
+    }
+
+    //everything after the state is runs.
+    long start = ftell(fp);
+    fseek(fp, 0, SEEK_END);
+    u32 len = ftell(fp) - start;
+    fseek(fp, start, SEEK_SET);
+
+    replay_stop();
+    clear_keyframes();
+
+    context.runs_cap = len ? len : 1;
+    context.runs = realloc(context.runs, context.runs_cap);
+    context.runs_len = fread(context.runs, 1, len, fp);
+    fclose(fp);
+
+    context.state_size = state_size;
+    push_keyframe(state);
+
+    context.start_frame = header.start_frame;
+    context.frames = header.frames;
+    context.play_pos = 0;
+    context.play_start = 0;
+    context.play_length = 0;
+    context.mode = REPLAY_PLAY;
+    context.loaded = true;
+
+    //the first keyframe is where the recording started from.
+    context.seek_frame = 0;
+    context.seek_pending = true;
+
+    printf("Playing %u frames of input from %s\n", context.frames, path);
+    return true;
+}
+
+void replay_seek(u32 frame) {
+    context.seek_frame = frame;
+    context.seek_pending = true;
+}
+
+void replay_stop() {
+    if (context.mode != REPLAY_RECORD) {
+        context.mode = REPLAY_OFF;
+        return;
+    }
+
+    context.mode = REPLAY_OFF;
+    flush_run();
+
+    if (!context.keyframe_count) {
+        //stopped before the first frame, nothing to write.
+        return;
+    }
+
+    FILE *fp = fopen(context.path, "wb");
+
+    if (!fp) {
+        fprintf(stderr, "FAILED TO OPEN: %s\n", context.path);
+        return;
+    }
+
+    replay_header header = {
+        .magic = REPLAY_MAGIC,
+        .version = REPLAY_VERSION,
+        .global_checksum = cart_global_checksum(),
+        .start_frame = context.start_frame,
+        .frames = context.frames,
+        .state_size = context.state_size
+    };
+
+    fwrite(&header, sizeof(header), 1, fp);
+    fwrite(context.keyframes[0], context.state_size, 1, fp);
+    fwrite(context.runs, context.runs_len, 1, fp);
+    fclose(fp);
+
+    printf("Recorded %u frames of input to %s\n", context.frames, context.path);
+}
+
+void replay_free(replay_context *replay) {
+    for (u32 i=0; i<replay->keyframe_count; i++) {
+        free(replay->keyframes[i]);
+    }
+
+    free(replay->keyframes);
+    free(replay->runs);
+}
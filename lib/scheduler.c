@@ -0,0 +1,148 @@
+#include <scheduler.h>
+#include <timer.h>
+#include <ppu.h>
+#include <apu.h>
+#include <dma.h>
+#include <string.h>
+#include <gb.h>
+
+
+
+#define context (gb_cur->sched)
+
+static EV_PROC handlers[EV_COUNT] = {
+    [EV_TIMER] = timer_event,
+    [EV_PPU] = ppu_event,
+    [EV_APU] = apu_event,
+    [EV_DMA] = dma_event
+};
+
+static void heap_swap(int a, int b) {
+    u8 ev = context.heap[a];
+    context.heap[a] = context.heap[b];
+    context.heap[b] = ev;
+
+    context.pos[context.heap[a]] = a;
+    context.pos[context.heap[b]] = b;
+}
+
+static u64 heap_when(int i) {
+    return context.when[context.heap[i]];
+}
+
+static void sift_up(int i) {
+    while (i > 0) {
+        int parent = (i - 1) / 2;
+
+        if (heap_when(parent) <= heap_when(i)) {
+            break;
+        }
+
+        heap_swap(i, parent);
+        i = parent;
+    }
+}
+
+static void sift_down(int i) {
+    while (true) {
+        int left = i * 2 + 1;
+        int right = left + 1;
+        int min = i;
+
+        if (left < context.size && heap_when(left) < heap_when(min)) {
+            min = left;
+        }
+
+        if (right < context.size && heap_when(right) < heap_when(min)) {
+            min = right;
+        }
+
+        if (min == i) {
+            break;
+        }
+
+        heap_swap(i, min);
+        i = min;
+    }
+}
+
+void sched_init() {
+    context.size = 0;
+
+    for (int i=0; i<EV_COUNT; i++) {
+        context.pos[i] = -1;
+        context.when[i] = SCHED_NEVER;
+    }
+}
+
+void sched_add(sched_event ev, u64 when) {
+    int i = context.pos[ev];
+
+    if (i < 0) {
+        i = context.size++;
+        context.heap[i] = ev;
+        context.pos[ev] = i;
+        context.when[ev] = when;
+        sift_up(i);
+        return;
+    }
+
+    u64 prev = context.when[ev];
+    context.when[ev] = when;
+
+    if (when < prev) {
+        sift_up(i);
+    } else {
+        sift_down(i);
+    }
+}
+
+void sched_remove(sched_event ev) {
+    int i = context.pos[ev];
+
+    if (i < 0) {
+        return;
+    }
+
+    context.size--;
+
+    if (i != context.size) {
+        heap_swap(i, context.size);
+        sift_down(i);
+        sift_up(i);
+    }
+
+    context.pos[ev] = -1;
+    context.when[ev] = SCHED_NEVER;
+}
+
+u64 sched_next() {
+    return sched_peek(&context);
+}
+
+void sched_run(u64 now) {
+    while (context.size && heap_when(0) <= now) {
+        sched_event ev = context.heap[0];
+        sched_remove(ev);
+
+        handlers[ev](now);
+    }
+}
+
+void sched_serialize(state_buf *s) {
+    //only the due ticks are stored, the heap is rebuilt from them.
+    u64 when[EV_COUNT];
+    memcpy(when, context.when, sizeof(when));
+
+    STATE_FIELD(s, when);
+
+    if (s->loading) {
+        sched_init();
+
+        for (int i=0; i<EV_COUNT; i++) {
+            if (when[i] != SCHED_NEVER) {
+                sched_add(i, when[i]);
+            }
+        }
+    }
+}
@@ -0,0 +1,14 @@
+#include <state.h>
+#include <string.h>
+
+void state_field(state_buf *s, void *field, u32 size) {
+    if (s->data) {
+        if (s->loading) {
+            memcpy(field, s->data + s->pos, size);
+        } else {
+            memcpy(s->data + s->pos, field, size);
+        }
+    }
+
+    s->pos += size;
+}
@@ -0,0 +1,16 @@
+#include <tile.h>
+
+//moves bit (7 - i) of b into byte i, little endian like every host we build for.
+#define SPREAD(b) ( \
+    ((u64)(((b) >> 7) & 1) << 0) | ((u64)(((b) >> 6) & 1) << 8) | \
+    ((u64)(((b) >> 5) & 1) << 16) | ((u64)(((b) >> 4) & 1) << 24) | \
+    ((u64)(((b) >> 3) & 1) << 32) | ((u64)(((b) >> 2) & 1) << 40) | \
+    ((u64)(((b) >> 1) & 1) << 48) | ((u64)(((b) >> 0) & 1) << 56))
+
+#define SPREAD4(b) SPREAD(b), SPREAD(b + 1), SPREAD(b + 2), SPREAD(b + 3)
+#define SPREAD16(b) SPREAD4(b), SPREAD4(b + 4), SPREAD4(b + 8), SPREAD4(b + 12)
+#define SPREAD64(b) SPREAD16(b), SPREAD16(b + 16), SPREAD16(b + 32), SPREAD16(b + 48)
+
+const u64 tile_spread[256] = {
+    SPREAD64(0), SPREAD64(64), SPREAD64(128), SPREAD64(192)
+};
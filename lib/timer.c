@@ -1,7 +1,13 @@
 #include <timer.h>
 #include <interrupts.h>
+#include <emu.h>
+#include <scheduler.h>
+#include <gb.h>
 
-static timer_context context = {0};
+#define context (gb_cur->timer)
+
+// div bit whose falling edge clocks TIMA, for each TAC clock select.
+static const u8 tac_bits[4] = {9, 3, 5, 7};
 
 timer_context *timer_get_context() {
     return &context;
@@ -9,42 +15,81 @@ timer_context *timer_get_context() {
 
 void timer_init() {
     context.div = 0xAC00;
+    context.sync_tick = emu_get_context()->ticks;
 }
 
-void timer_tick() {
-    u16 prev_div = context.div;
+static bool timer_enabled() {
+    return context.tac & (1 << 2);
+}
 
-    context.div++;
+static u32 timer_period() {
+    return 1 << (tac_bits[context.tac & (0b11)] + 1);
+}
 
-    bool timer_update = false;
+// TIMA increments left until it hits 0xFF and reloads.
+static u32 timer_to_reload() {
+    u8 n = 0xFF - context.tima;
 
-    switch(context.tac & (0b11)) {
-        case 0b00:
-            timer_update = (prev_div & (1 << 9)) && (!(context.div & (1 << 9)));
-            break;
-        case 0b01:
-            timer_update = (prev_div & (1 << 3)) && (!(context.div & (1 << 3)));
-            break;
-        case 0b10:
-            timer_update = (prev_div & (1 << 5)) && (!(context.div & (1 << 5)));
-            break;
-        case 0b11:
-            timer_update = (prev_div & (1 << 7)) && (!(context.div & (1 << 7)));
-            break;
+    return n ? n : 0x100;
+}
+
+static void timer_count(u64 edges) {
+    while (edges) {
+        u32 to_reload = timer_to_reload();
+
+        if (edges < to_reload) {
+            context.tima += edges;
+            return;
+        }
+
+        edges -= to_reload;
+        context.tima = context.tma;
+
+        cpu_request_interrupt(IT_TIMER);
     }
+}
 
-    if (timer_update && context.tac & (1 << 2)) {
-        context.tima++;
+// brings div/tima up to 'now' in one step instead of ticking every T-cycle.
+static void timer_sync(u64 now) {
+    u64 n = now - context.sync_tick;
 
-        if (context.tima == 0xFF) {
-            context.tima = context.tma;
+    if (!n) {
+        return;
+    }
 
-            cpu_request_interrupt(IT_TIMER);
-        }
+    u64 div = context.div;
+
+    if (timer_enabled()) {
+        //TIMA counts the falling edges of the selected div bit.
+        u8 shift = tac_bits[context.tac & (0b11)] + 1;
+        timer_count(((div + n) >> shift) - (div >> shift));
+    }
+
+    context.div = (u16)(div + n);
+    context.sync_tick = now;
+}
+
+static void timer_schedule() {
+    if (!timer_enabled()) {
+        sched_remove(EV_TIMER);
+        return;
     }
+
+    u32 period = timer_period();
+    u64 first_edge = period - (context.div & (period - 1));
+
+    sched_add(EV_TIMER, context.sync_tick + first_edge + 
+        (u64)(timer_to_reload() - 1) * period);
+}
+
+void timer_event(u64 now) {
+    timer_sync(now);
+    timer_schedule();
 }
 
 void timer_write(u16 address, u8 value) {
+    timer_sync(emu_get_context()->ticks);
+
     switch(address) {
         case 0xFF04:
             //DIV
@@ -66,9 +111,13 @@ void timer_write(u16 address, u8 value) {
             context.tac = value;
             break;
     }
+
+    timer_schedule();
 }
 
 u8 timer_read(u16 address) {
+    timer_sync(emu_get_context()->ticks);
+
     switch(address) {
         case 0xFF04:
             return context.div >> 8;
@@ -79,4 +128,8 @@ u8 timer_read(u16 address) {
         case 0xFF07:
             return context.tac;
     }
-}
\ No newline at end of file
+}
+
+void timer_serialize(state_buf *s) {
+    STATE_FIELD(s, context);
+}
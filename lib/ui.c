@@ -2,6 +2,7 @@
 #include <emu.h>
 #include <bus.h>
 #include <ppu.h>
+#include <tile.h>
 #include <gamepad.h>
 
 #include <SDL2/SDL.h>
@@ -11,7 +12,6 @@
 SDL_Window *sdlWindow;
 SDL_Renderer *sdlRenderer;
 SDL_Texture *sdlTexture;
-SDL_Surface *screen;
 
 // Global SDL objects for debug window (tile viewer)
 SDL_Window *sdlDebugWindow = NULL;
@@ -126,19 +126,7 @@ void ui_init() {
         return;
     }
     
-    // Create a software surface for drawing emulator pixels
-    screen = SDL_CreateRGBSurface(0, SCREEN_WIDTH, SCREEN_HEIGHT, 32,
-                                  0x00FF0000, // R mask
-                                  0x0000FF00, // G mask
-                                  0x000000FF, // B mask
-                                  0xFF000000);// A mask
-    
-    if (!screen) {
-        printf("Surface creation failed: %s\n", SDL_GetError());
-        return;
-    }
-
-    // Create a texture for uploading pixels to the GPU
+    // Create a texture the published frames are uploaded to directly
     sdlTexture = SDL_CreateTexture(sdlRenderer,
                                    SDL_PIXELFORMAT_ARGB8888,
                                    SDL_TEXTUREACCESS_STREAMING,
@@ -177,72 +165,56 @@ void display_tile(SDL_Surface *surface, u16 startLocation, u16 tileNum, int x, i
     SDL_Rect rc;
     int tile_scale = 2;  // Fixed scale for tile viewer
 
-    for (int tileY = 0; tileY < 16; tileY += 2) {
-        u8 b1 = bus_read(startLocation + (tileNum * 16) + tileY);
-        u8 b2 = bus_read(startLocation + (tileNum * 16) + tileY + 1);
+    //decoded straight from vram, the renderer's tile cache belongs to the
+    //cpu thread.
+    u16 tile = (startLocation - 0x8000) / 16 + tileNum;
+
+    if (tile >= TILE_COUNT) return;
 
-        for (int bit = 7; bit >= 0; bit--) {
-            u8 hi = !!(b1 & (1 << bit)) << 1;
-            u8 lo = !!(b2 & (1 << bit));
-            u8 color = hi | lo;
+    const u8 *data = ppu_get_context()->vram + tile * 16;
 
-            rc.x = x + ((7 - bit) * tile_scale);
-            rc.y = y + (tileY / 2 * tile_scale);
+    for (int row = 0; row < 8; row++) {
+        u8 index[8];
+        tile_decode_row(data[row * 2], data[row * 2 + 1], index);
+
+        for (int px = 0; px < 8; px++) {
+            rc.x = x + (px * tile_scale);
+            rc.y = y + (row * tile_scale);
             rc.w = tile_scale;
             rc.h = tile_scale;
 
-            SDL_FillRect(surface, &rc, tile_colors[color]);
+            SDL_FillRect(surface, &rc, tile_colors[index[px]]);
         }
     }
 }
 
-void ui_update() {
-    // CRITICAL: Add safety checks for PPU context
-    ppu_context *ppu_ctx = ppu_get_context();
-    if (!ppu_ctx) {
-        printf("ERROR: PPU context is NULL!\n");
-        return;
-    }
-    
-    if (!ppu_ctx->video_buffer) {
-        printf("ERROR: PPU video buffer is NULL!\n");
-        return;
-    }
-    
-    // Verify screen dimensions are valid
-    if (SCREEN_WIDTH <= 0 || SCREEN_HEIGHT <= 0) {
-        printf("ERROR: Invalid screen dimensions: %dx%d\n", SCREEN_WIDTH, SCREEN_HEIGHT);
-        return;
+bool ui_vsync() {
+    SDL_RendererInfo info;
+
+    if (!sdlRenderer || SDL_GetRendererInfo(sdlRenderer, &info) < 0) {
+        return false;
     }
-    
+
+    return (info.flags & SDL_RENDERER_PRESENTVSYNC) != 0;
+}
+
+bool ui_update() {
     // Safety check for SDL objects
-    if (!screen || !sdlTexture || !sdlRenderer) {
+    if (!sdlTexture || !sdlRenderer) {
         printf("ERROR: SDL objects not properly initialized\n");
-        return;
+        return false;
     }
-    
-    u32 *video_buffer = ppu_ctx->video_buffer;
-    
-    // Lock the surface for direct pixel access (more efficient)
-    if (SDL_LockSurface(screen) < 0) {
-        printf("ERROR: Could not lock surface: %s\n", SDL_GetError());
-        return;
-    }
-    
-    u32 *pixels = (u32*)screen->pixels;
-    
-    // Copy framebuffer directly to surface with bounds checking
-    int total_pixels = SCREEN_WIDTH * SCREEN_HEIGHT;
-    for (int i = 0; i < total_pixels; i++) {
-        pixels[i] = video_buffer[i];
+
+    // Newest frame the PPU published, it's ours until the next acquire
+    u32 *frame = ppu_frame_acquire();
+
+    if (!frame) {
+        return false;
     }
-    
-    SDL_UnlockSurface(screen);
-    
-    // Update texture with new pixel data
-    if (SDL_UpdateTexture(sdlTexture, NULL, screen->pixels, screen->pitch) < 0) {
+
+    if (SDL_UpdateTexture(sdlTexture, NULL, frame, SCREEN_WIDTH * sizeof(u32)) < 0) {
         printf("ERROR: Could not update texture: %s\n", SDL_GetError());
-        return;
+        return false;
     }
     
     // Clear renderer with background color
@@ -271,6 +243,7 @@ void ui_update() {
     
     // Present the frame
     SDL_RenderPresent(sdlRenderer);
+    return true;
 }
 
 void toggle_fullscreen() {
@@ -291,7 +264,7 @@ void toggle_aspect_ratio() {
 
 void ui_on_key(bool down, u32 key_code) {
     // Safety check for gamepad context
-    gamepad_state *gamepad = gamepad_get_state();
+    gamepad_state *gamepad = gamepad_get_keys();
     if (!gamepad) {
         printf("WARNING: Gamepad state is NULL\n");
         return;
@@ -327,6 +300,16 @@ void ui_on_key(bool down, u32 key_code) {
                     printf("Maintain aspect ratio: %s\n", maintain_aspect_ratio ? "ON" : "OFF");
                 }
                 break;
+            case SDLK_r:
+                if (SDL_GetModState() & KMOD_CTRL) {
+                    //only this thread writes it, the cpu thread picks it up
+                    //when the next line starts its transfer.
+                    ppu_context *ppu = ppu_get_context();
+                    ppu_renderer next = ppu->renderer == PPU_FIFO ? PPU_SCANLINE : PPU_FIFO;
+                    ppu->renderer = next;
+                    printf("Renderer: %s\n", next == PPU_FIFO ? "FIFO" : "SCANLINE");
+                }
+                break;
             case SDLK_ESCAPE:
                 if (fullscreen) {
                     toggle_fullscreen();
@@ -416,7 +399,6 @@ void ui_handle_events() {
 
 void ui_cleanup() {
     if (sdlTexture) SDL_DestroyTexture(sdlTexture);
-    if (screen) SDL_FreeSurface(screen);
     if (sdlRenderer) SDL_DestroyRenderer(sdlRenderer);
     if (sdlWindow) SDL_DestroyWindow(sdlWindow);
     
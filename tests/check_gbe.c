@@ -4,17 +4,653 @@
 #include <emu.h>
 
 #include <cpu.h>
+#include <scheduler.h>
+#include <gb.h>
+#include <blip.h>
+#include <tile.h>
+#include <ppu.h>
+#include <bus.h>
+#include <cart.h>
+#include <gamepad.h>
+#include <replay.h>
+#include <dma.h>
+#include <lcd.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
 
 START_TEST(test_nothing) {
     bool b = cpu_step();
     ck_assert_uint_eq(b, false);
 } END_TEST
 
+START_TEST(test_sched_order) {
+    sched_init();
+    ck_assert_uint_eq(sched_next(), ~(u64)0);
+
+    sched_add(EV_APU, 300);
+    sched_add(EV_TIMER, 100);
+    sched_add(EV_DMA, 200);
+    ck_assert_uint_eq(sched_next(), 100);
+
+    //rescheduling moves the event instead of adding it twice.
+    sched_add(EV_TIMER, 400);
+    ck_assert_uint_eq(sched_next(), 200);
+
+    sched_remove(EV_DMA);
+    ck_assert_uint_eq(sched_next(), 300);
+
+    sched_remove(EV_APU);
+    sched_remove(EV_TIMER);
+    ck_assert_uint_eq(sched_next(), ~(u64)0);
+} END_TEST
+
+START_TEST(test_state_reject) {
+    u8 buf[64] = {0};
+
+    //not a save state, must be refused before touching any subsystem.
+    ck_assert(!emu_load_state(buf, sizeof(buf)));
+    ck_assert(!emu_load_state(buf, 4));
+
+    //nor written past the end of a buffer too small to take it.
+    ck_assert_uint_eq(emu_save_state(buf, sizeof(buf)), 0);
+} END_TEST
+
+START_TEST(test_gb_instances) {
+    gb_t *def = gb_cur;
+    gb_t *a = gb_create();
+    gb_t *b = gb_create();
+
+    gb_select(a);
+    sched_init();
+    sched_add(EV_TIMER, 100);
+
+    gb_select(b);
+    sched_init();
+    ck_assert_uint_eq(sched_next(), ~(u64)0);
+
+    gb_select(a);
+    ck_assert_uint_eq(sched_next(), 100);
+
+    gb_select(def);
+    gb_destroy(a);
+    gb_destroy(b);
+} END_TEST
+
+START_TEST(test_blip_step) {
+    static blip_buffer b;
+    float out[BLIP_SIZE];
+
+    blip_clear(&b);
+    blip_add(&b, 10.5f, 1.0f);
+    blip_add(&b, 40.25f, -0.5f);
+    blip_read(&b, out, BLIP_SIZE, 1.0f);
+
+    //settles on each step's height once the kernel has passed.
+    ck_assert_float_eq_tol(out[0], 0.0f, 1e-5);
+    ck_assert_float_eq_tol(out[30], 1.0f, 1e-5);
+    ck_assert_float_eq_tol(out[BLIP_SIZE - 1], 0.5f, 1e-5);
+} END_TEST
+
+START_TEST(test_tile_decode) {
+    for (int lo=0; lo<256; lo++) {
+        for (int hi=0; hi<256; hi++) {
+            u8 index[8];
+
+            tile_decode_row(lo, hi, index);
+
+            for (int i=0; i<8; i++) {
+                u8 expect = ((lo >> (7 - i)) & 1) | (((hi >> (7 - i)) & 1) << 1);
+                ck_assert_uint_eq(index[i], expect);
+            }
+        }
+    }
+} END_TEST
+
+START_TEST(test_tile_cache) {
+    gb_t *def = gb_cur;
+    gb_select(gb_create());
+
+    sched_init();
+    ppu_init();
+
+    ppu_context *ppu = ppu_get_context();
+    ck_assert_uint_eq(ppu_tile_row(ppu, 1, 0)[0], 0);
+
+    //row 0 of tile 1, leftmost pixel gets both planes set.
+    bus_write(0x8010, 0x80);
+    bus_write(0x8011, 0x80);
+    ck_assert_uint_eq(ppu_tile_row(ppu, 1, 0)[0], 3);
+
+    bus_write(0x8011, 0x00);
+    ck_assert_uint_eq(ppu_tile_row(ppu, 1, 0)[0], 1);
+
+    gb_t *gb = gb_cur;
+    gb_select(def);
+    gb_destroy(gb);
+} END_TEST
+
+START_TEST(test_mbc5_banks) {
+    //32 rom banks that each start with their own number, 4 ram banks.
+    static u8 rom[32 * 0x4000];
+
+    for (int i=0; i<32; i++) {
+        rom[i * 0x4000] = i;
+    }
+
+    rom[0x147] = 0x1A;
+    rom[0x149] = 3;
+
+    char fn[] = "/tmp/gbe_mbcXXXXXX";
+    int fd = mkstemp(fn);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(write(fd, rom, sizeof(rom)), sizeof(rom));
+    close(fd);
+
+    gb_t *def = gb_cur;
+    gb_select(gb_create());
+    ck_assert(cart_load(fn));
+    unlink(fn);
+
+    ck_assert_uint_eq(bus_read(0x4000), 1);
+
+    bus_write(0x2000, 21);
+    ck_assert_uint_eq(bus_read(0x4000), 21);
+    ck_assert_uint_eq(cart_rom_bank(), 21);
+
+    //unlike mbc1, bank 0 can be switched in.
+    bus_write(0x2000, 0);
+    ck_assert_uint_eq(bus_read(0x4000), 0);
+
+    bus_write(0x0000, 0x0A);
+    bus_write(0x4000, 2);
+    bus_write(0xA000, 0x42);
+    bus_write(0x4000, 0);
+    ck_assert_uint_eq(bus_read(0xA000), 0);
+    bus_write(0x4000, 2);
+    ck_assert_uint_eq(bus_read(0xA000), 0x42);
+
+    bus_write(0x0000, 0x00);
+    ck_assert_uint_eq(bus_read(0xA000), 0xFF);
+
+    gb_t *gb = gb_cur;
+    gb_select(def);
+    gb_destroy(gb);
+} END_TEST
+
+// writes rom out to a temp file and loads it into a new selected machine.
+static gb_t *load_rom(const u8 *rom, u32 size) {
+    char fn[] = "/tmp/gbe_mbcXXXXXX";
+    int fd = mkstemp(fn);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(write(fd, rom, size), size);
+    close(fd);
+
+    gb_t *gb = gb_create();
+    gb_select(gb);
+    ck_assert(cart_load(fn));
+    unlink(fn);
+
+    return gb;
+}
+
+// deletes a temp directory and the files in it.
+static void remove_dir(const char *dir) {
+    char path[300];
+    DIR *d = opendir(dir);
+    struct dirent *e;
+
+    while (d && (e = readdir(d))) {
+        if (e->d_name[0] != '.') {
+            snprintf(path, sizeof(path), "%s/%s", dir, e->d_name);
+            unlink(path);
+        }
+    }
+
+    if (d) {
+        closedir(d);
+    }
+
+    rmdir(dir);
+}
+
+// selects a clock register, latches the clock and reads it back.
+static u8 rtc_read(u8 reg) {
+    bus_write(0x4000, reg);
+    bus_write(0x6000, 0);
+    bus_write(0x6000, 1);
+    return bus_read(0xA000);
+}
+
+static void rtc_write(u8 reg, u8 value) {
+    bus_write(0x4000, reg);
+    bus_write(0xA000, value);
+}
+
+START_TEST(test_mbc3_rtc) {
+    //mbc3 with the clock, ram and battery, 4 ram banks.
+    static u8 rom[4 * 0x4000];
+    char dir[] = "/tmp/gbe_savesXXXXXX";
+
+    rom[0x147] = 0x10;
+    rom[0x149] = 3;
+
+    ck_assert_ptr_nonnull(mkdtemp(dir));
+    cart_set_save_dir(dir);
+
+    gb_t *def = gb_cur;
+    gb_t *gb = load_rom(rom, sizeof(rom));
+    u64 *ticks = &emu_get_context()->ticks;
+
+    bus_write(0x0000, 0x0A);
+    rtc_write(0x08, 5);
+
+    //reads give the latched copy, which only moves on a 0 then 1 write.
+    bus_write(0x4000, 0x08);
+    ck_assert_uint_eq(bus_read(0xA000), 0);
+    ck_assert_uint_eq(rtc_read(0x08), 5);
+
+    *ticks += 3 * GB_CPU_HZ;
+    bus_write(0x6000, 1);
+    ck_assert_uint_eq(bus_read(0xA000), 5);
+    ck_assert_uint_eq(rtc_read(0x08), 8);
+
+    //a halted clock doesn't count the time going by.
+    rtc_write(0x0C, 0x40);
+    *ticks += 10 * GB_CPU_HZ;
+    ck_assert_uint_eq(rtc_read(0x08), 8);
+    rtc_write(0x0C, 0x00);
+    *ticks += 2 * GB_CPU_HZ;
+    ck_assert_uint_eq(rtc_read(0x08), 10);
+
+    //one second before day 512 carries out of the 9 bit day counter.
+    rtc_write(0x08, 59);
+    rtc_write(0x09, 59);
+    rtc_write(0x0A, 23);
+    rtc_write(0x0B, 0xFF);
+    rtc_write(0x0C, 0x01);
+    *ticks += GB_CPU_HZ;
+    ck_assert_uint_eq(rtc_read(0x08), 0);
+    ck_assert_uint_eq(rtc_read(0x0A), 0);
+    ck_assert_uint_eq(rtc_read(0x0B), 0);
+    ck_assert_uint_eq(rtc_read(0x0C), 0x80);
+
+    //0x4000 switches the same window between ram banks and the clock.
+    bus_write(0x4000, 0x01);
+    bus_write(0xA000, 0x42);
+    bus_write(0x4000, 0x00);
+    bus_write(0xA000, 0x24);
+    bus_write(0x4000, 0x0B);
+    ck_assert_uint_eq(bus_read(0xA000), 0);
+    bus_write(0x4000, 0x01);
+    ck_assert_uint_eq(bus_read(0xA000), 0x42);
+    bus_write(0x4000, 0x00);
+    ck_assert_uint_eq(bus_read(0xA000), 0x24);
+
+    gb_select(def);
+    gb_destroy(gb);
+
+    //the index and the battery file it handed out.
+    remove_dir(dir);
+    cart_set_save_dir("../saves");
+} END_TEST
+
+START_TEST(test_save_index) {
+    //two different battery games that share a name and a header checksum.
+    static u8 rom[0x8000];
+    char dirs[3][32] = {"/tmp/gbe_savesXXXXXX", "/tmp/gbe_romaXXXXXX", "/tmp/gbe_rombXXXXXX"};
+    char fn[2][64];
+    char saves[2][2100];
+    gb_t *def = gb_cur;
+
+    rom[0x147] = 0x03;
+    rom[0x149] = 2;
+
+    for (int i=0; i<3; i++) {
+        ck_assert_ptr_nonnull(mkdtemp(dirs[i]));
+    }
+
+    cart_set_save_dir(dirs[0]);
+
+    for (int i=0; i<2; i++) {
+        rom[0x150] = i;
+        snprintf(fn[i], sizeof(fn[i]), "%s/game.gb", dirs[i + 1]);
+
+        FILE *fp = fopen(fn[i], "wb");
+        ck_assert_ptr_nonnull(fp);
+        ck_assert_int_eq(fwrite(rom, sizeof(rom), 1, fp), 1);
+        fclose(fp);
+
+        //each game leaves its number in its own battery ram.
+        gb_t *gb = gb_create();
+        gb_select(gb);
+        ck_assert(cart_load(fn[i]));
+        bus_write(0x0000, 0x0A);
+        ck_assert_uint_eq(bus_read(0xA000), 0);
+        bus_write(0xA000, 0x10 + i);
+        snprintf(saves[i], sizeof(saves[i]), "%s", gb->cart.save_path);
+        gb_select(def);
+        gb_destroy(gb);
+    }
+
+    ck_assert_str_ne(saves[0], saves[1]);
+
+    for (int i=0; i<2; i++) {
+        gb_t *gb = gb_create();
+        gb_select(gb);
+        ck_assert(cart_load(fn[i]));
+        bus_write(0x0000, 0x0A);
+        ck_assert_uint_eq(bus_read(0xA000), 0x10 + i);
+        ck_assert_str_eq(gb->cart.save_path, saves[i]);
+        gb_select(def);
+        gb_destroy(gb);
+    }
+
+    for (int i=0; i<3; i++) {
+        remove_dir(dirs[i]);
+    }
+
+    cart_set_save_dir("../saves");
+} END_TEST
+
+START_TEST(test_mbc2) {
+    //16 rom banks that each start with their own number.
+    static u8 rom[16 * 0x4000];
+
+    for (int i=0; i<16; i++) {
+        rom[i * 0x4000] = i;
+    }
+
+    rom[0x147] = 0x05;
+
+    gb_t *def = gb_cur;
+    gb_t *gb = load_rom(rom, sizeof(rom));
+
+    //address bit 8 picks the register anywhere below 0x4000.
+    bus_write(0x2100, 3);
+    ck_assert_uint_eq(bus_read(0x4000), 3);
+    bus_write(0x0100, 5);
+    ck_assert_uint_eq(bus_read(0x4000), 5);
+
+    bus_write(0x2000, 0x0A);
+    ck_assert_uint_eq(bus_read(0x4000), 5);
+
+    //512 half bytes, the top half reads back as ones and it repeats.
+    bus_write(0xA000, 0xAB);
+    ck_assert_uint_eq(bus_read(0xA000), 0xFB);
+    ck_assert_uint_eq(bus_read(0xA200), 0xFB);
+    bus_write(0xA3FF, 0x07);
+    ck_assert_uint_eq(bus_read(0xA1FF), 0xF7);
+
+    bus_write(0x0000, 0x00);
+    ck_assert_uint_eq(bus_read(0xA000), 0xFF);
+
+    gb_select(def);
+    gb_destroy(gb);
+} END_TEST
+
+START_TEST(test_gamepad_pack) {
+    gamepad_state state = {0};
+
+    //replays store each frame's buttons as one byte.
+    for (int buttons=0; buttons<256; buttons++) {
+        gamepad_unpack(buttons, &state);
+        ck_assert_uint_eq(gamepad_pack(&state), buttons);
+    }
+
+    gamepad_unpack(0, &state);
+    state.right = true;
+    ck_assert_uint_eq(gamepad_pack(&state), 0x80);
+} END_TEST
+
+// a rom that keeps adding both halves of the joypad into c000 and c001, so
+// every frame's buttons end up in the state.
+static void write_input_rom(char *fn) {
+    static u8 rom[0x8000];
+    static const u8 code[] = {
+        0x21, 0x00, 0xC0,   //ld hl,c000
+        0x3E, 0x10,         //ld a,10
+        0xE0, 0x00,         //ldh (00),a
+        0xF0, 0x00,         //ldh a,(00)
+        0x86,               //add (hl)
+        0x77,               //ld (hl),a
+        0x3E, 0x20,         //ld a,20
+        0xE0, 0x00,         //ldh (00),a
+        0xF0, 0x00,         //ldh a,(00)
+        0x23,               //inc hl
+        0x86,               //add (hl)
+        0x77,               //ld (hl),a
+        0x2B,               //dec hl
+        0xC3, 0x03, 0x01    //jp 0103
+    };
+
+    memcpy(rom + 0x100, code, sizeof(code));
+
+    int fd = mkstemp(fn);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(write(fd, rom, sizeof(rom)), sizeof(rom));
+    close(fd);
+}
+
+static gb_t *start_machine(const char *rom) {
+    gb_t *gb = gb_create();
+    gb_select(gb);
+    ck_assert(cart_load((char *)rom));
+    emu_reset();
+
+    return gb;
+}
+
+static u8 *take_state() {
+    u8 *buf = malloc(emu_state_size());
+    ck_assert_uint_eq(emu_save_state(buf, emu_state_size()), emu_state_size());
+    return buf;
+}
+
+static void run_to_frame(u32 frame) {
+    while (ppu_get_context()->current_frame < frame) {
+        emu_step_frames(1);
+    }
+}
+
+// records 'frames' frames of changing input to path, returns the state at
+// the end and the frame it was taken on.
+static u8 *record_replay(const char *rom, const char *path, u32 frames, u32 *end) {
+    gb_t *gb = start_machine(rom);
+    emu_step_frames(5);
+    replay_record(path);
+
+    for (u32 f=0; f<frames; f++) {
+        gamepad_unpack((f / 7) * 13, gamepad_get_keys());
+        emu_step_frames(1);
+    }
+
+    u8 *state = take_state();
+    *end = ppu_get_context()->current_frame;
+    replay_stop();
+    gb_destroy(gb);
+
+    return state;
+}
+
+START_TEST(test_replay_playback) {
+    char rom[] = "/tmp/gbe_romXXXXXX";
+    char path[] = "/tmp/gbe_rpXXXXXX";
+    gb_t *def = gb_cur;
+    u32 end;
+
+    write_input_rom(rom);
+    close(mkstemp(path));
+
+    u8 *ref = record_replay(rom, path, 120, &end);
+
+    gb_t *gb = start_machine(rom);
+    ck_assert(replay_play(path));
+
+    //held host keys mustn't leak into the playback.
+    gamepad_unpack(0xFF, gamepad_get_keys());
+    emu_step_frames(1);
+    run_to_frame(end);
+
+    u8 *got = take_state();
+    ck_assert(!memcmp(ref, got, emu_state_size()));
+
+    free(got);
+    free(ref);
+    gb_select(def);
+    gb_destroy(gb);
+    unlink(rom);
+    unlink(path);
+} END_TEST
+
+START_TEST(test_replay_seek) {
+    char rom[] = "/tmp/gbe_romXXXXXX";
+    char path[] = "/tmp/gbe_rpXXXXXX";
+    gb_t *def = gb_cur;
+    u32 end;
+
+    write_input_rom(rom);
+    close(mkstemp(path));
+
+    //long enough for a second keyframe.
+    u8 *ref = record_replay(rom, path, REPLAY_KEYFRAME_INTERVAL + 100, &end);
+
+    gb_t *gb = start_machine(rom);
+    ck_assert(replay_play(path));
+    emu_step_frames(1);
+    run_to_frame(end);
+
+    //forward past a keyframe, then back before it.
+    const u32 seeks[] = {REPLAY_KEYFRAME_INTERVAL + 30, 50};
+
+    for (int i=0; i<2; i++) {
+        replay_seek(seeks[i]);
+        emu_step_frames(1);
+        run_to_frame(end);
+
+        u8 *got = take_state();
+        ck_assert(!memcmp(ref, got, emu_state_size()));
+        free(got);
+    }
+
+    free(ref);
+    gb_select(def);
+    gb_destroy(gb);
+    unlink(rom);
+    unlink(path);
+} END_TEST
+
+START_TEST(test_state_round_trip) {
+    //each pass retriggers square 1, writes a counter round wave ram, copies
+    //it into oam by dma and reads nr52 back, then waits about as long as
+    //the dma takes. anything lost over a save shows up in the next passes.
+    static const u8 code[] = {
+        0x3E, 0x80, 0xE0, 0x26, //ld a,80 / ldh (26),a
+        0x3E, 0x77, 0xE0, 0x24, //ld a,77 / ldh (24),a
+        0x3E, 0xFF, 0xE0, 0x25, //ld a,ff / ldh (25),a
+        0x3E, 0xF3, 0xE0, 0x12, //ld a,f3 / ldh (12),a
+        0x04, 0x78,             //inc b / ld a,b
+        0xEA, 0x00, 0xC0,       //ld (c000),a
+        0x3E, 0x87, 0xE0, 0x14, //ld a,87 / ldh (14),a
+        0x78, 0xE6, 0x0F,       //ld a,b / and 0f
+        0xF6, 0x30, 0x4F,       //or 30 / ld c,a
+        0x78, 0xE2,             //ld a,b / ld (ff00+c),a
+        0x3E, 0xC0, 0xE0, 0x46, //ld a,c0 / ldh (46),a
+        0xF0, 0x26,             //ldh a,(26)
+        0x1E, 0x28,             //ld e,28
+        0x1D, 0x20, 0xFD,       //dec e / jr nz,0129
+        0x18, 0xE2              //jr 0110
+    };
+    static u8 rom[0x8000];
+    char fn[] = "/tmp/gbe_romXXXXXX";
+
+    memcpy(rom + 0x100, code, sizeof(code));
+
+    int fd = mkstemp(fn);
+    ck_assert_int_ge(fd, 0);
+    ck_assert_int_eq(write(fd, rom, sizeof(rom)), sizeof(rom));
+    close(fd);
+
+    gb_t *def = gb_cur;
+    gb_t *gb = start_machine(fn);
+
+    emu_step_frames(3);
+
+    //then on to where a dma has started but hasn't copied anything yet.
+    for (int i=0; i<5000 || gb_cur->dma.byte || !dma_transferring(); i++) {
+        ck_assert_int_lt(i, 10000);
+        cpu_step();
+    }
+
+    //partway down the screen with a transfer and a sound write pending.
+    ck_assert(lcd_get_context()->ly > 0 && lcd_get_context()->ly < YRES);
+    ck_assert(dma_transferring());
+    ck_assert_uint_gt(gb_cur->apu.log_len, 0);
+
+    u32 size = emu_state_size();
+    u8 *saved = take_state();
+
+    for (int i=0; i<20; i++) {
+        cpu_step();
+    }
+
+    u8 *soon = take_state();
+    emu_step_frames(3);
+    u8 *after = take_state();
+    u32 *frame = malloc(YRES * XRES * sizeof(u32));
+    memcpy(frame, ppu_get_context()->video_buffer, YRES * XRES * sizeof(u32));
+
+    //into a fresh machine, nothing is left over from the first run.
+    gb_t *gb2 = start_machine(fn);
+    unlink(fn);
+
+    ck_assert(emu_load_state(saved, size));
+    u8 *loaded = take_state();
+    ck_assert(!memcmp(saved, loaded, size));
+
+    for (int i=0; i<20; i++) {
+        cpu_step();
+    }
+
+    free(loaded);
+    loaded = take_state();
+    ck_assert(!memcmp(soon, loaded, size));
+
+    emu_step_frames(3);
+    u8 *again = take_state();
+    ck_assert(!memcmp(after, again, size));
+    ck_assert(!memcmp(frame, ppu_get_context()->video_buffer, YRES * XRES * sizeof(u32)));
+
+    free(again);
+    free(loaded);
+    free(frame);
+    free(after);
+    free(soon);
+    free(saved);
+    gb_select(def);
+    gb_destroy(gb);
+    gb_destroy(gb2);
+} END_TEST
+
 Suite *stack_suite() {
     Suite *s = suite_create("emu");
     TCase *tc = tcase_create("core");
 
     tcase_add_test(tc, test_nothing);
+    tcase_add_test(tc, test_sched_order);
+    tcase_add_test(tc, test_state_reject);
+    tcase_add_test(tc, test_gb_instances);
+    tcase_add_test(tc, test_blip_step);
+    tcase_add_test(tc, test_tile_decode);
+    tcase_add_test(tc, test_tile_cache);
+    tcase_add_test(tc, test_mbc5_banks);
+    tcase_add_test(tc, test_mbc3_rtc);
+    tcase_add_test(tc, test_save_index);
+    tcase_add_test(tc, test_mbc2);
+    tcase_add_test(tc, test_gamepad_pack);
+    tcase_add_test(tc, test_replay_playback);
+    tcase_add_test(tc, test_replay_seek);
+    tcase_add_test(tc, test_state_round_trip);
     suite_add_tcase(s, tc);
 
     return s;